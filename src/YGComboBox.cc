@@ -64,8 +64,8 @@ class YGComboBox : public YComboBox, public YGLabeledWidget, public YGSelectionS
 		if (select) {
 			BlockEvents block (this);
 			GtkTreeIter iter;
-			getTreeIter (item, &iter);
-			gtk_combo_box_set_active_iter (getComboBox(), &iter);
+			if (getTreeIter (item, &iter))
+				gtk_combo_box_set_active_iter (getComboBox(), &iter);
 		}
 	}
 
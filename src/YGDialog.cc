@@ -306,6 +306,10 @@ YGDialog::YGDialog (YDialogType dialogType, YDialogColorMode colorMode)
 {
     setBorder (0);
     m_stickyTitle = false;
+    m_widgetIndexDirty = true;
+    m_layoutDirty = m_layoutFlushing = false;
+    m_sizeAsked [YD_HORIZ] = m_sizeAsked [YD_VERT] = false;
+    m_layoutId = 0;
     m_containee = gtk_event_box_new();
     if (dialogType == YMainDialog && main_window)
 		m_window = main_window;
@@ -338,6 +342,8 @@ YGDialog::YGDialog (YDialogType dialogType, YDialogColorMode colorMode)
 
 YGDialog::~YGDialog()
 {
+    if (m_layoutId)
+        g_source_remove (m_layoutId);
     YGWindow::unref (m_window);
 }
 
@@ -407,7 +413,70 @@ void YGDialog::busyCursor()
 
 // YWidget
 
+/* libyui calls YDialog::recalcLayout() after every property change that may
+   affect geometry, which measures the whole dialog and then sets its size.
+   Once the dialog is open, we just flag it and do a single pass when control
+   goes back to the main loop, so a script updating many widgets in a row
+   costs one layout. */
+
+int YGDialog::doPreferredSize (YUIDimension dimension)
+{
+	if (isOpen() && !m_layoutFlushing) {
+		m_layoutDirty = true;
+		return 0;  // unused: doSetSize() defers to flushLayout()
+	}
+	// setters like YGLabel's only queue a GTK resize, so the cached sizes
+	// may be stale; libyui asks for both dimensions before setting the size,
+	// so measure afresh once per such pass, as flushLayout() does
+	if (!m_layoutFlushing) {
+		int other = dimension == YD_HORIZ ? YD_VERT : YD_HORIZ;
+		if (m_sizeAsked [dimension] || !m_sizeAsked [other]) {
+			invalidatePreferredSizes();
+			m_sizeAsked [other] = false;
+		}
+		m_sizeAsked [dimension] = true;
+	}
+	return YGWidget::doPreferredSize (dimension);
+}
+
 void YGDialog::doSetSize (int width, int height)
+{
+	struct inner {
+		static gboolean relayout_cb (gpointer pData)
+		{
+			YGDialog *pThis = (YGDialog *) pData;
+			pThis->m_layoutId = 0;
+			pThis->flushLayout();
+			return FALSE;
+		}
+	};
+
+	m_sizeAsked [YD_HORIZ] = m_sizeAsked [YD_VERT] = false;
+	if (m_layoutDirty) {
+		// run ahead of GTK's own resize and redraw
+		if (!m_layoutId)
+			m_layoutId = g_idle_add_full (G_PRIORITY_HIGH_IDLE, inner::relayout_cb, this, NULL);
+		return;
+	}
+	resizeWindow (width, height);
+}
+
+void YGDialog::flushLayout()
+{
+	if (m_layoutId) {
+		g_source_remove (m_layoutId);
+		m_layoutId = 0;
+	}
+	if (m_layoutDirty) {
+		m_layoutDirty = false;
+		m_layoutFlushing = true;
+		invalidatePreferredSizes();  // measure once for both dimensions
+		recalcLayout();
+		m_layoutFlushing = false;
+	}
+}
+
+void YGDialog::resizeWindow (int width, int height)
 {
 	// libyui calls YDialog::setSize() to force a geometry recalculation as a
 	// result of changed layout properties
@@ -545,36 +614,44 @@ void YGDialog::setIcon (const std::string &icon)
 	}
 }
 
-typedef bool (*FindWidgetsCb) (YWidget *widget, void *data) ;
-
-static void findWidgets (
-	std::list <YWidget *> *widgets, YWidget *widget, FindWidgetsCb find_cb, void *cb_data)
+void YGDialog::buildWidgetIndex()
 {
-	if (find_cb (widget, cb_data))
-		widgets->push_back (widget);
-	for (YWidgetListConstIterator it = widget->childrenBegin();
-	     it != widget->childrenEnd(); it++)
-		findWidgets (widgets, *it, find_cb, cb_data);
-}
+	struct inner {
+		static void add (YGDialog *pThis, YWidget *widget)
+		{
+			int key = widget->functionKey();
+			if (key)  // first one in tree order wins
+				pThis->m_functionWidgets.insert (std::make_pair (key, widget));
+			pThis->m_classWidgets [widget->widgetClass()].push_back (widget);
+			for (YWidgetListConstIterator it = widget->childrenBegin();
+			     it != widget->childrenEnd(); it++)
+				add (pThis, *it);
+		}
+	};
 
-static bool IsFunctionWidget (YWidget *widget, void *data)
-{ return widget->functionKey() == GPOINTER_TO_INT (data); }
+	m_functionWidgets.clear();
+	m_classWidgets.clear();
+	inner::add (this, this);
+	m_widgetIndexDirty = false;
+}
 
 YWidget *YGDialog::getFunctionWidget (int key)
 {
-	std::list <YWidget *> widgets;
-	findWidgets (&widgets, this, IsFunctionWidget, GINT_TO_POINTER (key));
-	return widgets.empty() ? NULL : widgets.front();
+	// setFunctionKey() marks the index dirty, so a clean index is current
+	if (m_widgetIndexDirty)
+		buildWidgetIndex();
+	std::map <int, YWidget *>::const_iterator it = m_functionWidgets.find (key);
+	return it == m_functionWidgets.end() ? NULL : it->second;
 }
 
-static bool IsClassWidget (YWidget *widget, void *data)
-{ return !strcmp (widget->widgetClass(), (char *) data); }
-
-std::list <YWidget *> YGDialog::getClassWidgets (const char *className)
+const std::list <YWidget *> &YGDialog::getClassWidgets (const char *className)
 {
-	std::list <YWidget *> widgets;
-	findWidgets (&widgets, this, IsClassWidget, (void *) className);
-	return widgets;
+	static const std::list <YWidget *> empty;
+	if (m_widgetIndexDirty)
+		buildWidgetIndex();
+	std::map <const char *, std::list <YWidget *>, StrLess>::const_iterator it =
+		m_classWidgets.find (className);
+	return it == m_classWidgets.end() ? empty : it->second;
 }
 
 YDialog *YGWidgetFactory::createDialog (YDialogType dialogType, YDialogColorMode colorMode)
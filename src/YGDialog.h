@@ -7,6 +7,8 @@
 
 #include "YGWidget.h"
 #include "YDialog.h"
+#include <map>
+#include <string.h>
 
 class YGWindow;
 typedef bool (*YGWindowCloseFn) (void *closure);
@@ -18,6 +20,22 @@ class YGDialog : public YDialog, public YGWidget
 	YGWindow *m_window;
 	bool m_stickyTitle;
 
+	// widgets by function key and by class, rebuilt after the tree changes
+	struct StrLess {
+		bool operator() (const char *a, const char *b) const
+		{ return strcmp (a, b) < 0; }
+	};
+	std::map <int, YWidget *> m_functionWidgets;
+	std::map <const char *, std::list <YWidget *>, StrLess> m_classWidgets;
+	bool m_widgetIndexDirty;
+	void buildWidgetIndex();
+
+	// layout requests made while open are batched into one idle pass
+	bool m_layoutDirty, m_layoutFlushing;
+	bool m_sizeAsked [2];  // dimensions measured since the size was last set
+	guint m_layoutId;
+	void resizeWindow (int width, int height);
+
 public:
 	YGDialog (YDialogType dialogType, YDialogColorMode colorMode);
 	virtual ~YGDialog();
@@ -39,7 +57,9 @@ public:
 	static YGDialog *currentDialog();
 	static GtkWindow *currentWindow();
 
+	virtual int doPreferredSize (YUIDimension dimension);
 	virtual void doSetSize (int width, int height);
+	void flushLayout();  // do a pending relayout now, for immediate geometry
 
 	virtual void openInternal();
 	virtual void activate();
@@ -54,7 +74,8 @@ public:
 	void setIcon (const std::string &icon);
 
 	YWidget *getFunctionWidget (int key);
-	std::list <YWidget *> getClassWidgets (const char *className);
+	const std::list <YWidget *> &getClassWidgets (const char *className);
+	void invalidateWidgetIndex() { m_widgetIndexDirty = true; }
 
 	YGWIDGET_IMPL_CONTAINER (YDialog)
 };
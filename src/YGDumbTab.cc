@@ -30,7 +30,7 @@ public:
 		// GTK+ keeps the notebook size set to the biggset page. We can't
 		// do this since pages are set dynamically, but at least don't let
 		// the notebook reduce its size.
-		ygtk_adj_size_set_only_expand (YGTK_ADJ_SIZE (m_adj_size), TRUE);
+		setOnlyExpand (true);
 
 		connect (getWidget(), "switch-page", G_CALLBACK (switch_page_cb), this);
 	}
@@ -21,13 +21,29 @@ static void doMoveChild (GtkWidget *fixed, YWidget *ychild, int x, int y)
 	ygtk_fixed_set_child_pos (YGTK_FIXED (fixed), child, x, y);
 }
 
+/* GTK only re-measures a YGtkFixed once something inside it queued a resize,
+   so the outermost measure starts a new pass of cached preferred sizes. */
+struct MeasurePass
+{
+	MeasurePass()
+	{ if (depth++ == 0) YGWidget::invalidatePreferredSizes(); }
+	~MeasurePass()
+	{ depth--; }
+
+	private: static int depth;
+};
+
+int MeasurePass::depth = 0;
+
 #define YGLAYOUT_INIT                                          \
 	ygtk_fixed_setup (YGTK_FIXED (getWidget()), preferred_width_cb, preferred_height_cb, set_size_cb, this);
 #define YGLAYOUT_PREFERRED_SIZE_IMPL(ParentClass) \
 	static gint preferred_width_cb (YGtkFixed *fixed, gpointer pThis) {  \
+		MeasurePass pass;                                                \
 		return ((ParentClass *) pThis)->ParentClass::preferredWidth();   \
 	}                                                                    \
 	static gint preferred_height_cb (YGtkFixed *fixed, gpointer pThis) { \
+		MeasurePass pass;                                                \
 		return ((ParentClass *) pThis)->ParentClass::preferredHeight();  \
 	}
 #define YGLAYOUT_SET_SIZE_IMPL(ParentClass)                             \
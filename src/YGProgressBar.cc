@@ -12,7 +12,8 @@
 #include "YGWidget.h"
 #include "YGi18n.h"
 
-std::string size_stdform (YFileSize_t size)
+// writes e.g. "1.5 MB" into buf, without allocating
+static void size_stdform (YFileSize_t size, char *buf, gsize len)
 {
 	long double mantissa = size;
 	int unit = 0;
@@ -30,16 +31,16 @@ std::string size_stdform (YFileSize_t size)
 		default: mantissa = 0; break;
 	}
 
-	gchar *text = g_strdup_printf ("%.1f %s", (float) mantissa, unit_str);
-	std::string str (text);
-	g_free (text);
-	return str;
+	g_snprintf (buf, len, "%.1f %s", (float) mantissa, unit_str);
 }
 
 #include "YProgressBar.h"
 
 class YGProgressBar : public YProgressBar, public YGLabeledWidget
 {
+guint m_tick_id;
+int m_shown_percent;
+
 public:
 	YGProgressBar (YWidget *parent, const std::string &label, int maxValue)
 	: YProgressBar (NULL, label, maxValue)
@@ -47,22 +48,62 @@ public:
 		// may change often and so will its size, which will look odd (we may want
 		// to make the label widget to only grow).
 	, YGLabeledWidget (this, parent, label, YD_VERT, GTK_TYPE_PROGRESS_BAR, NULL)
+	, m_tick_id (0), m_shown_percent (-1)
 	{}
 
+	virtual ~YGProgressBar()
+	{
+		if (m_tick_id)
+			gtk_widget_remove_tick_callback (getWidget(), m_tick_id);
+	}
+
 	// YProgressBar
 	virtual void setValue (int value)
 	{
+		// backends may report thousands of ticks a second: only keep the
+		// latest value, and show it on the next frame -- unless the main loop
+		// isn't running for us (no UI thread), as frames would never come
 		YProgressBar::setValue (value);
+		if (YGUI::ui()->syncProgress() || !YGUI::ui()->runningWithThreads() ||
+		    !gtk_widget_get_mapped (getWidget()))
+			flush();
+		else if (!m_tick_id)
+			m_tick_id = gtk_widget_add_tick_callback (getWidget(), tick_cb, this, NULL);
+	}
+
+	// paints the current value right away, when ticks can't be relied upon
+	void flush()
+	{
+		if (m_tick_id) {
+			gtk_widget_remove_tick_callback (getWidget(), m_tick_id);
+			m_tick_id = 0;
+		}
+		sync();
+		gtk_main_iteration_do (false);
+	}
+
+	void sync()
+	{
 		GtkProgressBar *bar = GTK_PROGRESS_BAR (getWidget());
-		float fraction = CLAMP ((float) value / maxValue(), 0, 1);
+		float fraction = CLAMP ((float) value() / maxValue(), 0, 1);
 		gtk_progress_bar_set_fraction (bar, fraction);
 
-		char *text = g_strdup_printf ("%d %%", (int) (fraction*100));
-		gtk_progress_bar_set_text (bar, text);
-		g_free (text);
-		gtk_progress_bar_set_show_text(bar, true);
+		int percent = (int) (fraction*100);
+		if (percent != m_shown_percent) {
+			char *text = g_strdup_printf ("%d %%", percent);
+			gtk_progress_bar_set_text (bar, text);
+			g_free (text);
+			gtk_progress_bar_set_show_text(bar, true);
+			m_shown_percent = percent;
+		}
+	}
 
-		gtk_main_iteration_do(false);
+	static gboolean tick_cb (GtkWidget *widget, GdkFrameClock *clock, gpointer pData)
+	{
+		YGProgressBar *pThis = (YGProgressBar *) pData;
+		pThis->m_tick_id = 0;
+		pThis->sync();
+		return G_SOURCE_REMOVE;
 	}
 
 	virtual unsigned int getMinSize (YUIDimension dim)
@@ -79,43 +120,142 @@ YProgressBar *YGWidgetFactory::createProgressBar (YWidget *parent, const std::st
 
 #include "YDownloadProgress.h"
 
+/* Without a file monitor, we poll the file size: quickly while it grows,
+   backing off while it doesn't. */
+#define MIN_POLL_INTERVAL 100
+#define MAX_POLL_INTERVAL 2000
+
 class YGDownloadProgress : public YDownloadProgress, public YGLabeledWidget
 {
-guint timeout_id;
+guint timeout_id, tick_id, poll_interval;
+GFileMonitor *monitor;
+std::string monitored_file;
+YFileSize_t shown_size, shown_expected;
 
 public:
 	YGDownloadProgress (YWidget *parent, const std::string &label,
 	                    const std::string &filename, YFileSize_t expectedFileSize)
 	: YDownloadProgress (NULL, label, filename, expectedFileSize)
 	, YGLabeledWidget (this, parent, label, YD_HORIZ, GTK_TYPE_PROGRESS_BAR, NULL)
+	, timeout_id (0), tick_id (0), poll_interval (MIN_POLL_INTERVAL), monitor (NULL)
+	, shown_size (-1), shown_expected (-1)
 	{
-		timeout_id = g_timeout_add (250, timeout_cb, this);
+		watch();
+		update();
 	}
 
 	virtual ~YGDownloadProgress()
 	{
-		g_source_remove (timeout_id);
+		unwatch();
+		if (tick_id)
+			gtk_widget_remove_tick_callback (getWidget(), tick_id);
 	}
 
 	virtual void setExpectedSize (YFileSize_t size)
 	{
 		YDownloadProgress::setExpectedSize (size);
-		timeout_cb (this);  // force an update
+		update();  // force an update
+	}
+
+	virtual void setFilename (const std::string &filename)
+	{
+		YDownloadProgress::setFilename (filename);
+		watch();
+		update();
+	}
+
+	void watch()
+	{
+		unwatch();
+		monitored_file = filename();
+		GFile *file = g_file_new_for_path (monitored_file.c_str());
+		monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, NULL);
+		g_object_unref (G_OBJECT (file));
+		if (monitor) {
+			// the default limit of 800 ms would update slower than we polled
+			g_file_monitor_set_rate_limit (monitor, 250);
+			g_signal_connect (G_OBJECT (monitor), "changed",
+			                  G_CALLBACK (file_changed_cb), this);
+		}
+		else {
+			poll_interval = MIN_POLL_INTERVAL;
+			timeout_id = g_timeout_add (poll_interval, poll_cb, this);
+		}
 	}
 
-	static gboolean timeout_cb (void *pData)
+	void unwatch()
+	{
+		if (monitor) {
+			g_signal_handlers_disconnect_by_data (monitor, this);
+			g_file_monitor_cancel (monitor);
+			g_object_unref (G_OBJECT (monitor));
+			monitor = NULL;
+		}
+		if (timeout_id) {
+			g_source_remove (timeout_id);
+			timeout_id = 0;
+		}
+	}
+
+	// returns whether the displayed size changed
+	bool update()
+	{
+		YFileSize_t size = currentFileSize(), expected = expectedSize();
+		if (size == shown_size && expected == shown_expected)
+			return false;
+		shown_size = size;
+		shown_expected = expected;
+
+		GtkProgressBar *bar = GTK_PROGRESS_BAR (getWidget());
+		int percent = 0;
+		if (expected > 0)
+			percent = CLAMP ((int) ((100.0 * size) / expected), 0, 100);
+		gtk_progress_bar_set_fraction (bar, percent / 100.0);
+		if (expected > 0) {
+			char current [32], total [32], text [128];
+			size_stdform (size, current, sizeof (current));
+			size_stdform (expected, total, sizeof (total));
+			g_snprintf (text, sizeof (text), "%s %s %s", current, _("of"), total);
+			gtk_progress_bar_set_text (bar, text);
+		}
+		return true;
+	}
+
+	// callbacks
+	static void file_changed_cb (GFileMonitor *monitor, GFile *file, GFile *other_file,
+	                             GFileMonitorEvent event, YGDownloadProgress *pThis)
+	{
+		// writes may come in bursts: show them at most once a frame
+		if (!pThis->tick_id)
+			pThis->tick_id = gtk_widget_add_tick_callback (pThis->getWidget(),
+				tick_cb, pThis, NULL);
+	}
+
+	static gboolean tick_cb (GtkWidget *widget, GdkFrameClock *clock, gpointer pData)
+	{
+		YGDownloadProgress *pThis = (YGDownloadProgress *) pData;
+		pThis->tick_id = 0;
+		if (pThis->filename() != pThis->monitored_file)
+			pThis->watch();
+		pThis->update();
+		return G_SOURCE_REMOVE;
+	}
+
+	static gboolean poll_cb (void *pData)
 	{
 		YGDownloadProgress *pThis = (YGDownloadProgress*) pData;
-		GtkProgressBar *bar = GTK_PROGRESS_BAR (pThis->getWidget());
-
-		gtk_progress_bar_set_fraction (bar, pThis->currentPercent() / 100.0);
-		if (pThis->expectedSize() > 0) {
-			std::string current (size_stdform (pThis->currentFileSize()));
-			std::string total (size_stdform (pThis->expectedSize()));
-			std::string text = current + " " + _("of") + " " + total;
-			gtk_progress_bar_set_text (GTK_PROGRESS_BAR (bar), text.c_str());
+		pThis->timeout_id = 0;
+		if (pThis->filename() != pThis->monitored_file) {
+			pThis->watch();
+			pThis->update();
+			return FALSE;
 		}
-		return TRUE;
+		if (pThis->update())
+			pThis->poll_interval = MIN_POLL_INTERVAL;
+		else
+			pThis->poll_interval = MIN (pThis->poll_interval * 2, MAX_POLL_INTERVAL);
+		pThis->timeout_id = g_timeout_add (pThis->poll_interval, poll_cb, pThis);
+		return FALSE;
 	}
 
 	YGLABEL_WIDGET_IMPL (YDownloadProgress)
@@ -150,8 +290,7 @@ public:
 			ygtk_ratio_box_pack (YGTK_RATIO_BOX (getWidget()), bar, getSegmentWeight (s));
 		}
 
-		ygtk_adj_size_set_max (YGTK_ADJ_SIZE (m_adj_size), horizontal() ? 200 : 0,
-		                                                   horizontal() ? 0 : 200);
+		setMaxSize (horizontal() ? 200 : 0, horizontal() ? 0 : 200);
 		gtk_widget_show_all (getWidget());
 	}
 
@@ -75,9 +75,9 @@ public:
 			setStockIcon (label());
 	}
 
-	virtual void setFunctionKey (int key)
+	virtual void doSetFunctionKey (int key)
 	{
-		YPushButton::setFunctionKey (key);
+		YGWidget::doSetFunctionKey (key);
 		if (!m_labelIcon && hasFunctionKey())
 			setStockIcon (label());
 	}
@@ -222,8 +222,7 @@ public:
 	{	// enlarge button if parent is ButtonBox
 		YWidget *yparent = pThis->m_ywidget->parent();
 		if (yparent && !strcmp (yparent->widgetClass(), "YButtonBox"))
-			ygtk_adj_size_set_min (YGTK_ADJ_SIZE(pThis->getLayout()),
-				DEFAULT_CHILD_MIN_WIDTH, DEFAULT_CHILD_MIN_HEIGHT);
+			pThis->setMinSize (DEFAULT_CHILD_MIN_WIDTH, DEFAULT_CHILD_MIN_HEIGHT);
 	}
 
 	YGWIDGET_IMPL_COMMON (YPushButton)
@@ -17,11 +17,18 @@ static inline int getRowIdCol (GtkTreeModel *model)
 { return gtk_tree_model_get_n_columns (model) - 1; }
 
 YGSelectionStore::YGSelectionStore (bool tree)
-: isTree (tree), m_nextRowId (0)
-{}
+: isTree (tree), m_nextRowId (0), m_labelIndex (NULL), m_labelIndexCol (-1)
+{
+	m_rowIndex = g_hash_table_new_full (NULL, NULL, NULL,
+		(GDestroyNotify) gtk_tree_iter_free);
+}
 
 YGSelectionStore::~YGSelectionStore()
-{ g_object_unref (G_OBJECT (m_model)); }
+{
+	invalidateLabelIndex();
+	g_hash_table_destroy (m_rowIndex);
+	g_object_unref (G_OBJECT (m_model));
+}
 
 void YGSelectionStore::createStore (int cols, const GType types[])
 {
@@ -40,18 +47,18 @@ void YGSelectionStore::createStore (int cols, const GType types[])
 
 void YGSelectionStore::addRow (YItem *item, GtkTreeIter *iter, GtkTreeIter *parent)
 {
-	if (isTree) {
-		GtkTreeStore *store = GTK_TREE_STORE (m_model);
-		gtk_tree_store_append (store, iter, parent);
-		gtk_tree_store_set (store, iter, getYItemCol (m_model), item,
-			getRowIdCol (m_model), m_nextRowId, -1);
-	}
-	else {
-		GtkListStore *store = getListStore();
-		gtk_list_store_append (store, iter);
-		gtk_list_store_set (store, iter, getYItemCol (m_model), item,
-			getRowIdCol (m_model), m_nextRowId, -1);
-	}
+	// insert_with_values() fills the row before anyone is told about it, so
+	// a sorted model only has to place it once
+	if (isTree)
+		gtk_tree_store_insert_with_values (getTreeStore(), iter, parent, -1,
+			getYItemCol (m_model), item, getRowIdCol (m_model), m_nextRowId, -1);
+	else
+		gtk_list_store_insert_with_values (getListStore(), iter, -1,
+			getYItemCol (m_model), item, getRowIdCol (m_model), m_nextRowId, -1);
+	// list and tree stores keep their iters valid for as long as the row
+	// lives (even across sorting), so we can just keep a copy around
+	g_hash_table_insert (m_rowIndex, m_nextRowId, gtk_tree_iter_copy (iter));
+	invalidateLabelIndex();
 	item->setData (m_nextRowId);
 	m_nextRowId = GINT_TO_POINTER (GPOINTER_TO_INT (m_nextRowId) + 1);
 }
@@ -64,12 +71,16 @@ void YGSelectionStore::setRowText (GtkTreeIter *iter, int iconCol, const std::st
 		pixbuf = YGUtils::loadPixbuf (path);
 	}
 
+	if (labelCol == m_labelIndexCol)
+		invalidateLabelIndex();
 	if (isTree)
 		gtk_tree_store_set (getTreeStore(), iter, iconCol, pixbuf,
 			labelCol, label.c_str(), -1);
 	else
 		gtk_list_store_set (getListStore(), iter, iconCol, pixbuf,
 			labelCol, label.c_str(), -1);
+	if (pixbuf)
+		g_object_unref (G_OBJECT (pixbuf));
 }
 
 void YGSelectionStore::setRowMark (GtkTreeIter *iter, int markCol, bool mark)
@@ -86,6 +97,8 @@ void YGSelectionStore::doDeleteAllItems()
 		gtk_tree_store_clear (getTreeStore());
 	else
 		gtk_list_store_clear (getListStore());
+	g_hash_table_remove_all (m_rowIndex);
+	invalidateLabelIndex();
 	m_nextRowId = 0;
 }
 
@@ -96,28 +109,12 @@ YItem *YGSelectionStore::getYItem (GtkTreeIter *iter)
 	return (YItem *) ptr;
 }
 
-static GtkTreeIter *found_iter;
-
-void YGSelectionStore::getTreeIter (const YItem *item, GtkTreeIter *iter)
+bool YGSelectionStore::getTreeIter (const YItem *item, GtkTreeIter *iter)
 {
-	struct inner {
-		static gboolean foreach_find (
-			GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter, gpointer find_id)
-		{
-			gpointer id;
-			gtk_tree_model_get (model, iter, getRowIdCol (model), &id, -1);
-			if (id == find_id) {
-				found_iter = gtk_tree_iter_copy (iter);
-				return TRUE;
-			}
-			return FALSE;
-		}
-	};
-
-	found_iter = NULL;
-	gtk_tree_model_foreach (m_model, inner::foreach_find, item->data());
-	*iter = *found_iter;
-	gtk_tree_iter_free (found_iter);
+	GtkTreeIter *found = (GtkTreeIter *) g_hash_table_lookup (m_rowIndex, item->data());
+	if (found)
+		*iter = *found;
+	return found != NULL;
 }
 
 GtkListStore *YGSelectionStore::getListStore()
@@ -149,33 +146,44 @@ int YGSelectionStore::getTreeDepth()
 	return depth;
 }
 
-#include <string.h>
-static int find_col;
+void YGSelectionStore::invalidateLabelIndex()
+{
+	if (m_labelIndex) {
+		g_hash_table_destroy (m_labelIndex);
+		m_labelIndex = NULL;
+	}
+	m_labelIndexCol = -1;
+}
 
 bool YGSelectionStore::findLabel (int labelCol, const std::string &label, GtkTreeIter *iter)
 {
 	struct inner {
-		static gboolean foreach_find (
-			GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter, gpointer _value)
+		static gboolean foreach_index (
+			GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter, gpointer _pThis)
 		{
-			gchar *value = (gchar *) _value;
+			YGSelectionStore *pThis = (YGSelectionStore *) _pThis;
 			gchar *v;
-			gtk_tree_model_get (model, iter, find_col, &v, -1);
-			if (!strcmp (v, value)) {
-				found_iter = gtk_tree_iter_copy (iter);
-				return TRUE;
-			}
+			gtk_tree_model_get (model, iter, pThis->m_labelIndexCol, &v, -1);
+			if (!v) return FALSE;
+			// on duplicates, the first row wins (as with a linear scan)
+			if (g_hash_table_lookup (pThis->m_labelIndex, v))
+				g_free (v);
+			else
+				g_hash_table_insert (pThis->m_labelIndex, v, gtk_tree_iter_copy (iter));
 			return FALSE;
 		}
 	};
 
-	find_col = labelCol;
-	found_iter = NULL;
-	gtk_tree_model_foreach (m_model, inner::foreach_find, (gpointer) label.c_str());
-	if (found_iter) {
-		*iter = *found_iter;
-		gtk_tree_iter_free (found_iter);
+	if (m_labelIndexCol != labelCol) {
+		invalidateLabelIndex();
+		m_labelIndex = g_hash_table_new_full (g_str_hash, g_str_equal,
+			g_free, (GDestroyNotify) gtk_tree_iter_free);
+		m_labelIndexCol = labelCol;
+		gtk_tree_model_foreach (m_model, inner::foreach_index, this);
 	}
-	return found_iter != NULL;
-}
 
+	GtkTreeIter *found = (GtkTreeIter *) g_hash_table_lookup (m_labelIndex, label.c_str());
+	if (found)
+		*iter = *found;
+	return found != NULL;
+}
@@ -26,7 +26,8 @@ struct YGSelectionStore
 	void doDeleteAllItems();
 
 	YItem *getYItem (GtkTreeIter *iter);
-	void getTreeIter (const YItem *item, GtkTreeIter *iter);
+	// false, leaving iter untouched, for items not in the store
+	bool getTreeIter (const YItem *item, GtkTreeIter *iter) G_GNUC_WARN_UNUSED_RESULT;
 
 	GtkListStore *getListStore();
 	GtkTreeStore *getTreeStore();
@@ -40,6 +41,11 @@ protected:
 	GtkTreeModel *m_model;
 	bool isTree;
 	gpointer m_nextRowId;
+	GHashTable *m_rowIndex;  // row id -> GtkTreeIter (our stores' iters persist)
+	GHashTable *m_labelIndex;  // label -> first GtkTreeIter; built on demand
+	int m_labelIndexCol;
+
+	void invalidateLabelIndex();
 };
 
 #define YGSELECTION_WIDGET_IMPL(ParentClass)             \
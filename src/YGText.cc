@@ -146,16 +146,107 @@ YMultiLineEdit *YGWidgetFactory::createMultiLineEdit (YWidget *parent, const std
 }
 
 #include "YLogView.h"
+#include <deque>
+#include <string.h>
 
 class YGLogView : public YLogView, public YGTextView
 {
-std::string m_text;
+	/* Rather than keeping a copy of the whole log to tell what changed, we
+	   keep a record of each line shown (without its newline); libyui only
+	   ever appends lines and drops the oldest ones. */
+	struct Line {
+		gsize bytes, chars;
+		guint hash;
+	};
+	std::deque <Line> m_lines;  // always at least one (maybe empty) line
+	gsize m_bytes;  // size of the text shown
+
+	static guint hashBytes (guint hash, const char *str, gsize len)
+	{
+		while (len--)
+			hash = (hash << 5) + hash + (guchar) *(str++);
+		return hash;
+	}
+
+	void clearLines()
+	{
+		Line empty = { 0, 0, 5381 };
+		m_lines.clear();
+		m_lines.push_back (empty);
+		m_bytes = 0;
+	}
+
+	// appends to the records; the text continues the last line
+	void pushLines (const char *text, gsize len)
+	{
+		const char *end = text + len;
+		while (true) {
+			const char *nl = (const char *) memchr (text, '\n', end - text);
+			gsize bytes = (nl ? nl : end) - text;
+			Line &last = m_lines.back();
+			last.hash = hashBytes (last.hash, text, bytes);
+			last.bytes += bytes;
+			last.chars += g_utf8_strlen (text, bytes);
+			if (!nl) break;
+			Line empty = { 0, 0, 5381 };
+			m_lines.push_back (empty);
+			text = nl+1;
+		}
+		m_bytes += len;
+	}
+
+	// removes the given number of lines from the top, in one go
+	void trimLines (unsigned int count)
+	{
+		if (!count) return;
+		gint chars = 0;
+		for (unsigned int i = 0; i < count; i++) {
+			chars += m_lines.front().chars + 1;
+			m_bytes -= m_lines.front().bytes + 1;
+			m_lines.pop_front();
+		}
+
+		BlockEvents block (this);
+		GtkTextIter start_it, end_it;
+		gtk_text_buffer_get_start_iter (getBuffer(), &start_it);
+		gtk_text_buffer_get_iter_at_offset (getBuffer(), &end_it, chars);
+		gtk_text_buffer_delete (getBuffer(), &start_it, &end_it);
+	}
+
+	/* Finds how many of the lines shown were dropped from the top of 'text',
+	   checking that the remaining ones start it. Returns -1 if 'text' isn't
+	   a continuation of what we show. */
+	int findRetainedLines (const std::string &text)
+	{
+		const char *str = text.data();
+		const char *nl = (const char *) memchr (str, '\n', text.size());
+		gsize first_bytes = nl ? (gsize) (nl - str) : text.size();
+		guint first_hash = hashBytes (5381, str, first_bytes);
+
+		unsigned int last = m_lines.size()-1;
+		gsize retained = m_bytes;  // size of lines [k, last]
+		for (unsigned int k = 0; k <= last; retained -= m_lines[k++].bytes + 1) {
+			const Line &line = m_lines[k];
+			if (retained > text.size())
+				continue;
+			if (k == last)  // may have been continued
+				return hashBytes (5381, str, line.bytes) == line.hash ? k : -1;
+			if (line.bytes != first_bytes || line.hash != first_hash)
+				continue;
+			const Line &last_line = m_lines[last];
+			gsize offset = retained - last_line.bytes;
+			if (str[offset-1] == '\n' &&
+			    hashBytes (5381, str + offset, last_line.bytes) == last_line.hash)
+				return k;
+		}
+		return -1;
+	}
 
 public:
 	YGLogView (YWidget *parent, const std::string &label, int visibleLines, int maxLines)
 	: YLogView (NULL, label, visibleLines, maxLines)
 	, YGTextView (this, parent, label, false)
-	{}
+	{ clearLines(); }
 
 	// YLogView
 	virtual void displayLogText (const std::string &text)
@@ -163,24 +254,33 @@ public:
 		// libyui calls clearText before setting it: let's ignore it
 		if (text.empty()) return;
 
-		if (text.compare (0, m_text.size(), m_text) == 0) {
-			if (text.size() == m_text.size()) return;
+		int dropped = findRetainedLines (text);
+		if (dropped >= 0) {
+			gsize retained = m_bytes;
+			for (int i = 0; i < dropped; i++)
+				retained -= m_lines[i].bytes + 1;
+			if (dropped == 0 && retained == text.size()) return;
 
 			// appending text: avoid flickering and allow user to scroll freely
 			GtkAdjustment *vadj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE (getWidget()));
 			bool autoScroll = gtk_adjustment_get_value(vadj) >= gtk_adjustment_get_upper(vadj) - gtk_adjustment_get_page_size(vadj);
 
-			std::string diff (text.substr (m_text.size()));
+			trimLines (dropped);
+			std::string diff (text, retained);
 			YGTextView::appendText (diff);
+			pushLines (diff.data(), diff.size());
+			if (maxLines() > 0 && m_lines.size() > (unsigned) maxLines())
+				trimLines (m_lines.size() - maxLines());
 			if (autoScroll)
 				YGTextView::scrollToBottom();
 
 		}
 		else {
 			YGTextView::setText (text);
+			clearLines();
+			pushLines (text.data(), text.size());
 			YGTextView::scrollToBottom();
 		}
-		m_text = text;
 	}
 
 	// YGWidget
@@ -25,6 +25,19 @@ protected:
 	guint m_blockTimeout;
 	int markColumn;
 	GtkWidget *m_count;
+	int m_markCount;  // rows checked at markColumn
+#ifndef NDEBUG
+	int m_debugCount;
+#endif
+	int m_bulkInsert;  // nesting level of beginBulkInsert()
+	gint m_bulkSortColumn;
+	GtkSortType m_bulkSortOrder;
+	std::list <YItem *> m_bulkFocus;  // focus requests while the model is detached
+	GHashTable *m_markAggregates;  // for trees: YItem -> MarkAggregate
+
+	struct MarkAggregate {  // of a node's descendants
+		int marked, total;
+	};
 
 public:
 	YGTreeView (YWidget *ywidget, YWidget *parent, const std::string &label, bool tree)
@@ -44,12 +57,17 @@ public:
 
 		m_blockTimeout = 0;  // GtkTreeSelection idiotically fires when showing widget
 		markColumn = -1; m_count = NULL;
+		m_markCount = 0; m_bulkInsert = 0;
+		m_markAggregates = NULL;
 		blockSelected();
 		g_signal_connect (getWidget(), "map", G_CALLBACK (block_init_cb), this);
 	}
 
 	virtual ~YGTreeView()
-	{ if (m_blockTimeout) g_source_remove (m_blockTimeout); }
+	{
+		if (m_blockTimeout) g_source_remove (m_blockTimeout);
+		if (m_markAggregates) g_hash_table_destroy (m_markAggregates);
+	}
 
 	inline GtkTreeView *getView()
 	{ return GTK_TREE_VIEW (getWidget()); }
@@ -101,8 +119,11 @@ public:
 
 		gtk_tree_view_column_set_resizable (column, TRUE);
 		gtk_tree_view_append_column (getView(), column);
-		if (markColumn == -1)
+		if (markColumn == -1) {
 			markColumn = check_col;
+			if (isTree)
+				m_markAggregates = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+		}
 	}
 
 	void readModel()
@@ -125,10 +146,95 @@ public:
 		}
 	}
 
+	/* Inserts item collections in bulk: sorting is only done once all rows
+	   are in, and the view is detached meanwhile if it is being populated
+	   from scratch. */
+	void beginBulkInsert()
+	{
+		if (m_bulkInsert++) return;
+		blockSelected();
+
+		GtkTreeSortable *sortable = GTK_TREE_SORTABLE (getModel());
+		if (gtk_tree_sortable_get_sort_column_id (sortable, &m_bulkSortColumn, &m_bulkSortOrder))
+			gtk_tree_sortable_set_sort_column_id (sortable,
+				GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID, GTK_SORT_ASCENDING);
+		else  // not sorted by any column
+			m_bulkSortColumn = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+		// detaching would lose the current selection; only do so when empty
+		if (isEmpty())
+			gtk_tree_view_set_model (getView(), NULL);
+	}
+
+	void endBulkInsert()
+	{
+		if (--m_bulkInsert) return;
+
+		GtkTreeSortable *sortable = GTK_TREE_SORTABLE (getModel());
+		if (m_bulkSortColumn != GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID)
+			gtk_tree_sortable_set_sort_column_id (sortable, m_bulkSortColumn, m_bulkSortOrder);
+		if (!gtk_tree_view_get_model (getView())) {
+			readModel();
+			std::list <YItem *> focus;
+			focus.swap (m_bulkFocus);
+			for (std::list <YItem *>::iterator it = focus.begin(); it != focus.end(); it++)
+				focusItem (*it, true);
+		}
+		syncCount();
+	}
+
+	/* Rows and marks must go through here (rather than YGSelectionStore's)
+	   so that the count and the tree aggregates are kept up to date. */
+	void addRow (YItem *item, GtkTreeIter *iter, GtkTreeIter *parent = 0)
+	{
+		YGSelectionStore::addRow (item, iter, parent);
+		if (m_markAggregates && parent)
+			updateMarkAggregates (iter, 0, 1);
+	}
+
+	void setRowMark (GtkTreeIter *iter, int column, bool mark)
+	{
+		if (column == markColumn) {
+			gboolean old_mark;
+			gtk_tree_model_get (getModel(), iter, column, &old_mark, -1);
+			if (old_mark != mark) {
+				m_markCount += mark ? 1 : -1;
+				if (m_markAggregates)
+					updateMarkAggregates (iter, mark ? 1 : -1, 0);
+			}
+		}
+		YGSelectionStore::setRowMark (iter, column, mark);
+	}
+
+	void doDeleteAllItems()
+	{
+		YGSelectionStore::doDeleteAllItems();
+		m_markCount = 0;
+		if (m_markAggregates)
+			g_hash_table_remove_all (m_markAggregates);
+	}
+
+	void updateMarkAggregates (GtkTreeIter *iter, int marked, int total)
+	{
+		GtkTreeIter child = *iter, parent;
+		while (gtk_tree_model_iter_parent (getModel(), &parent, &child)) {
+			YItem *item = getYItem (&parent);
+			MarkAggregate *aggregate = (MarkAggregate *)
+				g_hash_table_lookup (m_markAggregates, item);
+			if (!aggregate) {
+				aggregate = g_new0 (MarkAggregate, 1);
+				g_hash_table_insert (m_markAggregates, item, aggregate);
+			}
+			aggregate->marked += marked;
+			aggregate->total += total;
+			child = parent;
+		}
+	}
+
 	void syncCount()
 	{
-		if (!m_count) return;
+		if (!m_count || m_bulkInsert) return;
 
+#ifndef NDEBUG
 		struct inner {
 			static gboolean foreach (
 				GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter, gpointer _pThis)
@@ -136,28 +242,38 @@ public:
 				YGTreeView *pThis = (YGTreeView *) _pThis;
 				gboolean mark;
 				gtk_tree_model_get (model, iter, pThis->markColumn, &mark, -1);
-				if (mark) {
-					int count = GPOINTER_TO_INT (g_object_get_data (G_OBJECT (model), "count"));
-					g_object_set_data (G_OBJECT (model), "count", GINT_TO_POINTER (count+1));
-				}
+				if (mark)
+					pThis->m_debugCount++;
 				return FALSE;
 			}
 		};
 
-		GtkTreeModel *model = getModel();
-		g_object_set_data (G_OBJECT (model), "count", 0);
-		gtk_tree_model_foreach (model, inner::foreach, this);
+		m_debugCount = 0;
+		gtk_tree_model_foreach (getModel(), inner::foreach, this);
+		if (m_debugCount != m_markCount) {
+			yuiError() << "Selection count out of sync: " << m_markCount
+			           << " instead of " << m_debugCount << std::endl;
+			m_markCount = m_debugCount;
+		}
+#endif
 
-		int count = GPOINTER_TO_INT (g_object_get_data (G_OBJECT (model), "count"));
-		gchar *str = g_strdup_printf ("%d", count);
+		gchar *str = g_strdup_printf ("%d", m_markCount);
 		gtk_label_set_text (GTK_LABEL (m_count), str);
 		g_free (str);
 	}
 
 	void focusItem (YItem *item, bool select)
 	{
+		if (m_bulkInsert && !gtk_tree_view_get_model (getView())) {
+			m_bulkFocus.remove (item);
+			if (select)
+				m_bulkFocus.push_back (item);
+			return;
+		}
+
 		GtkTreeIter iter;
-		getTreeIter (item, &iter);
+		if (!getTreeIter (item, &iter))
+			return;
 		blockSelected();
 
 		if (select) {
@@ -192,7 +308,8 @@ public:
 			}
 		};
 
-		gtk_tree_model_foreach (getModel(), inner::foreach_unmark, this);
+		if (m_markCount > 0)
+			gtk_tree_model_foreach (getModel(), inner::foreach_unmark, this);
 	}
 
 	YItem *getFocusItem()
@@ -216,8 +333,8 @@ public:
 			for (YItemConstIterator it = yitem->childrenBegin();
 				 it != yitem->childrenEnd(); it++) {
 				GtkTreeIter _iter;
-				getTreeIter (*it, &_iter);
-				setMark (&_iter, *it, column, state, true);
+				if (getTreeIter (*it, &_iter))
+					setMark (&_iter, *it, column, state, true);
 			}
 	}
 
@@ -264,26 +381,20 @@ protected:
 
 	// callbacks
 
-	static bool all_marked (GtkTreeModel *model, GtkTreeIter *iter, int mark_col)
-	{
-		gboolean marked;
-		GtkTreeIter child_iter;
-		if (gtk_tree_model_iter_children (model, &child_iter, iter))
-			do {
-				gtk_tree_model_get (model, &child_iter, mark_col, &marked, -1);
-				if (!marked) return false;
-				all_marked (model, &child_iter, mark_col);
-			} while (gtk_tree_model_iter_next (model, &child_iter));
-		return true;
-	}
-
 	static void inconsistent_mark_cb (GtkTreeViewColumn *column,
 		GtkCellRenderer *cell, GtkTreeModel *model, GtkTreeIter *iter, gpointer data)
 	{  // used for trees -- show inconsistent if one node is check but another isn't
 		YGTreeView *pThis = (YGTreeView *) data;
-		gboolean marked;
-		gtk_tree_model_get (model, iter, pThis->markColumn, &marked, -1);
-		gboolean consistent = !marked || all_marked (model, iter, pThis->markColumn);
+		gboolean consistent = TRUE;
+		if (pThis->m_markAggregates) {
+			gboolean marked;
+			gtk_tree_model_get (model, iter, pThis->markColumn, &marked, -1);
+			if (marked) {
+				MarkAggregate *aggregate = (MarkAggregate *) g_hash_table_lookup (
+					pThis->m_markAggregates, pThis->getYItem (iter));
+				consistent = !aggregate || aggregate->marked == aggregate->total;
+			}
+		}
 		g_object_set (G_OBJECT (cell), "inconsistent", !consistent, NULL);
 	}
 
@@ -341,13 +452,26 @@ protected:
 	{ pThis->emitEvent (YEvent::ContextMenuActivated); }
 };
 
+#define YGTREE_VIEW_BULK_IMPL(ParentClass)                             \
+	virtual void addItems (const YItemCollection &items) {             \
+		beginBulkInsert();                                             \
+		ParentClass::addItems (items);                                 \
+		endBulkInsert();                                               \
+	}
+
 #include "YTable.h"
 #include "YGDialog.h"
 #include <gdk/gdkkeysyms.h>
 #include <string.h>
+#include <vector>
 
 class YGTable : public YTable, public YGTreeView
 {
+	// collation keys of the cells, by column and row id; a column's keys are
+	// only computed once it is sorted, and kept up to date from then on
+	std::vector <std::vector <std::string> > m_sortKeys;
+	std::vector <bool> m_hasSortKeys;
+
 public:
 	YGTable (YWidget *parent, YTableHeader *headers, bool multiSelection)
 	: YTable (NULL, headers, multiSelection),
@@ -376,6 +500,11 @@ public:
 		if (lastAlign == YAlignCenter || lastAlign == YAlignEnd)
 			gtk_tree_view_append_column (getView(), gtk_tree_view_column_new());
 
+		m_sortKeys.resize (columns());
+		m_hasSortKeys.resize (columns(), false);
+		g_signal_connect (getModel(), "sort-column-changed",
+		                  G_CALLBACK (sort_column_changed_cb), this);
+
 		g_signal_connect (getWidget(), "key-press-event", G_CALLBACK (key_press_event_cb), this);
 	}
 
@@ -391,7 +520,7 @@ public:
 				int index = (n*2)+1;
 				gtk_tree_sortable_set_sort_func (
 					GTK_TREE_SORTABLE (getModel()), index, tree_sort_cb,
-					GINT_TO_POINTER (index), NULL);
+					this, NULL);
 				gtk_tree_view_column_set_sort_column_id (column, index);
 			}
 			else
@@ -407,10 +536,97 @@ public:
 		if (label == "X")
 			label = YUI::app()->glyph (YUIGlyph_CheckMark);
 
+		if (m_hasSortKeys[column])  // before the store re-sorts the row
+			setSortKey (column, getYItem (iter), label.c_str());
+
 		int index = column * 2;
 		setRowText (iter, index, cell->iconName(), index+1, label, this);
 	}
 
+	/* Cells that read as a number, optionally followed by a size unit (e.g.
+	   "1.5 MiB"), sort by magnitude ahead of text; text is compared with
+	   digits-aware collation so that "9" comes before "10". */
+	static std::string sortKey (const char *str)
+	{
+		static const struct { const char *unit; double factor; } units[] = {
+			{ "", 1 }, { "B", 1 },
+			{ "kB", 1e3 }, { "KB", 1024. }, { "KiB", 1024. }, { "K", 1024. },
+			{ "MB", 1e6 }, { "MiB", 1024.*1024 }, { "M", 1024.*1024 },
+			{ "GB", 1e9 }, { "GiB", 1024.*1024*1024 }, { "G", 1024.*1024*1024 },
+			{ "TB", 1e12 }, { "TiB", 1024.*1024*1024*1024 },
+		};
+
+		const char *s = str;
+		while (g_ascii_isspace (*s)) s++;
+		if (g_ascii_isdigit (*s) || ((*s == '-' || *s == '.') && g_ascii_isdigit (s[1]))) {
+			char *end;
+			double value = g_ascii_strtod (s, &end);
+			while (g_ascii_isspace (*end)) end++;
+			for (unsigned int i = 0; i < G_N_ELEMENTS (units); i++) {
+				int len = strlen (units[i].unit);
+				if (strncmp (end, units[i].unit, len))
+					continue;
+				const char *rest = end + len;
+				while (g_ascii_isspace (*rest)) rest++;
+				if (*rest)
+					continue;
+
+				// map the double onto an unsigned integer with the same order
+				union { gdouble d; guint64 u; } bits;
+				bits.d = value * units[i].factor;
+				if (bits.u >> 63)
+					bits.u = ~bits.u;
+				else
+					bits.u |= G_GUINT64_CONSTANT (1) << 63;
+				char key [18];
+				g_snprintf (key, sizeof (key), "0%016" G_GINT64_MODIFIER "x", bits.u);
+				return key;
+			}
+		}
+
+		gchar *collate = g_utf8_collate_key_for_filename (str, -1);
+		std::string key ("1");
+		key += collate;
+		g_free (collate);
+		return key;
+	}
+
+	void setSortKey (int column, YItem *item, const char *label)
+	{
+		std::vector <std::string> &keys = m_sortKeys[column];
+		unsigned int row = GPOINTER_TO_INT (item->data());
+		if (row >= keys.size())
+			keys.resize (row+1);
+		keys[row] = sortKey (label);
+	}
+
+	void buildSortKeys (int column)
+	{
+		struct inner {
+			YGTable *pThis;
+			int column;
+
+			static gboolean foreach_key (
+				GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter, gpointer _data)
+			{
+				inner *data = (inner *) _data;
+				gchar *label;
+				gtk_tree_model_get (model, iter, data->column*2+1, &label, -1);
+				data->pThis->setSortKey (data->column, data->pThis->getYItem (iter),
+					label ? label : "");
+				g_free (label);
+				return FALSE;
+			}
+		};
+
+		if (m_hasSortKeys[column]) return;
+		m_sortKeys[column].clear();
+		m_sortKeys[column].reserve (gtk_tree_model_iter_n_children (getModel(), NULL));
+		inner data = { this, column };
+		gtk_tree_model_foreach (getModel(), inner::foreach_key, &data);
+		m_hasSortKeys[column] = true;
+	}
+
 	// YGTreeView
 
 	virtual bool _immediateMode() { return immediateMode(); }
@@ -431,8 +647,8 @@ public:
 	virtual void cellChanged (const YTableCell *cell)
 	{
 		GtkTreeIter iter;
-		getTreeIter (cell->parent(), &iter);
-		setCell (&iter, cell->column(), cell);
+		if (getTreeIter (cell->parent(), &iter))
+			setCell (&iter, cell->column(), cell);
 	}
 
 	// YGSelectionStore
@@ -460,6 +676,20 @@ public:
 			yuiError() << "Can only add YTableItems to a YTable.\n";
     }
 
+	void doDeleteAllItems()
+	{
+		YGTreeView::doDeleteAllItems();
+		for (int i = 0; i < columns(); i++) {
+			m_sortKeys[i].clear();
+			m_hasSortKeys[i] = false;
+		}
+		// the store stays sorted: rows added later need their keys
+		gint index;
+		GtkSortType order;
+		if (gtk_tree_sortable_get_sort_column_id (GTK_TREE_SORTABLE (getModel()), &index, &order))
+			buildSortKeys (index / 2);
+	}
+
 	void doSelectItem (YItem *item, bool select)
 	{ focusItem (item, select); }
 
@@ -530,22 +760,34 @@ public:
 		return FALSE;
 	}
 
+	static void sort_column_changed_cb (GtkTreeSortable *sortable, YGTable *pThis)
+	{
+		gint index;
+		GtkSortType order;
+		if (gtk_tree_sortable_get_sort_column_id (sortable, &index, &order))
+			pThis->buildSortKeys (index / 2);
+	}
+
 	static gint tree_sort_cb (
-		GtkTreeModel *model, GtkTreeIter *a, GtkTreeIter *b, gpointer _index)
+		GtkTreeModel *model, GtkTreeIter *a, GtkTreeIter *b, gpointer _pThis)
 	{
-		int index = GPOINTER_TO_INT (_index);
-		gchar *str_a, *str_b;
-		gtk_tree_model_get (model, a, index, &str_a, -1);
-		gtk_tree_model_get (model, b, index, &str_b, -1);
-		if (!str_a) str_a = g_strdup ("");
-		if (!str_b) str_b = g_strdup ("");
-		int ret = strcmp (str_a, str_b);
-		g_free (str_a); g_free (str_b);
-		return ret;
+		YGTable *pThis = (YGTable *) _pThis;
+		gint index;
+		GtkSortType order;
+		gtk_tree_sortable_get_sort_column_id (GTK_TREE_SORTABLE (model), &index, &order);
+		const std::vector <std::string> &keys = pThis->m_sortKeys[index / 2];
+
+		// rows are compared before their cells are set as they get inserted
+		unsigned int row_a = GPOINTER_TO_INT (pThis->getYItem (a)->data());
+		unsigned int row_b = GPOINTER_TO_INT (pThis->getYItem (b)->data());
+		const char *key_a = row_a < keys.size() ? keys[row_a].c_str() : "";
+		const char *key_b = row_b < keys.size() ? keys[row_b].c_str() : "";
+		return strcmp (key_a, key_b);
 	}
 
 	YGLABEL_WIDGET_IMPL (YTable)
 	YGSELECTION_WIDGET_IMPL (YTable)
+	YGTREE_VIEW_BULK_IMPL (YTable)
 };
 
 YTable *YGWidgetFactory::createTable (YWidget *parent, YTableHeader *headers,
@@ -592,6 +834,7 @@ public:
 
 	YGLABEL_WIDGET_IMPL (YSelectionBox)
 	YGSELECTION_WIDGET_IMPL (YSelectionBox)
+	YGTREE_VIEW_BULK_IMPL (YSelectionBox)
 };
 
 YSelectionBox *YGWidgetFactory::createSelectionBox (YWidget *parent, const std::string &label)
@@ -632,7 +875,8 @@ public:
 	void doSelectItem (YItem *item, bool select)
 	{
 		GtkTreeIter iter;
-		getTreeIter (item, &iter);
+		if (!getTreeIter (item, &iter))
+			return;
 		setRowMark (&iter, 0, select);
 		syncCount();
 	}
@@ -650,6 +894,7 @@ public:
 
 	YGLABEL_WIDGET_IMPL (YMultiSelectionBox)
 	YGSELECTION_WIDGET_IMPL (YMultiSelectionBox)
+	YGTREE_VIEW_BULK_IMPL (YMultiSelectionBox)
 };
 
 YMultiSelectionBox *YGWidgetFactory::createMultiSelectionBox (YWidget *parent, const std::string &label)
@@ -761,7 +1006,8 @@ public:
 
 	void _markItem (YItem *item, bool select, bool recursive) {
 		GtkTreeIter iter;
-		getTreeIter (item, &iter);
+		if (!getTreeIter (item, &iter))
+			return;
 		setRowMark (&iter, 2, select);
 
 		if (recursive) {
@@ -47,7 +47,7 @@ YGUI::YGUI (bool with_threads)
 {
 	yuiMilestone() << "This is libyui-gtk " << VERSION << std::endl;
 
-	m_no_border = m_fullscreen = m_swsingle = false;
+	m_no_border = m_fullscreen = m_swsingle = m_sync_progress = m_flat_layout = false;
 
 	YGUI::setTextdomain( TEXTDOMAIN );
 
@@ -129,13 +129,19 @@ void YGUI::checkInit()
 			m_fullscreen = true;
 		else if (!strcmp (argp, "noborder"))
 			m_no_border = true;
+		else if (!strcmp (argp, "syncprogress"))
+			m_sync_progress = true;
+		else if (!strcmp (argp, "flatlayout"))
+			m_flat_layout = true;
 		else if (!strcmp (argp, "help")) {
 			printf ("%s",
 				_("Command line options for the YaST2 UI (GTK plugin):\n\n"
-				"--noborder    no window manager border for main dialogs\n"
-				"--fullscreen  use full screen for main dialogs\n"
-				"--nothreads   run without additional UI threads\n"
-				"--help        prints this help text\n"
+				"--noborder      no window manager border for main dialogs\n"
+				"--fullscreen    use full screen for main dialogs\n"
+				"--nothreads     run without additional UI threads\n"
+				"--syncprogress  repaint progress bars on every change\n"
+				"--flatlayout    no size wrapper around each widget\n"
+				"--help          prints this help text\n"
 				"\n"
 				));
 			exit (0);
@@ -396,6 +402,7 @@ void YGApplication::makeScreenShot (const std::string &_filename)
 			errorMsg (_("No dialog to take screenshot of."));
 		return;
 	}
+	YGDialog::currentDialog()->flushLayout();
 
         GtkAllocation alloc;
         gtk_widget_get_allocation(widget, &alloc);
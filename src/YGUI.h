@@ -65,12 +65,15 @@ private:
 
     // window-related arguments
     bool m_no_border, m_fullscreen, m_swsingle;
+    bool m_sync_progress, m_flat_layout;
 
 public:
     // Helpers for internal use [ visibility hidden ]
     bool setFullscreen() const { return m_fullscreen; }
     bool unsetBorder() const   { return m_no_border; }
     bool isSwsingle() const    { return m_swsingle; }
+    bool syncProgress() const  { return m_sync_progress; }
+    bool flatLayout() const    { return m_flat_layout; }
 };
 
 #include <YWidgetFactory.h>
@@ -15,86 +15,100 @@
 static inline void skipSpace (const char *instr, int *i)
 { while (g_ascii_isspace (instr[*i])) (*i)++; }
 
+/* Open tags are kept on a stack; their names live back to back in a single
+   buffer, so pushing and popping doesn't allocate per tag. */
 typedef struct {
-	GString     *tag;
+	gsize        name;  // offset into TagStack::names
 	int          tag_len : 31;
 	unsigned int early_closer : 1;
 } TagEntry;
 
-static TagEntry *
-tag_entry_new (GString *tag, int tag_len)
+typedef struct {
+	GArray  *entries;  // of TagEntry
+	GString *names;
+} TagStack;
+
+static inline const char *tag_stack_name (TagStack *stack, const TagEntry *entry)
+{ return stack->names->str + entry->name; }
+
+static inline TagEntry *tag_stack_peek (TagStack *stack)
 {
-	static const char *early_closers[] = { "p", "li" };
-	TagEntry *entry = g_new (TagEntry, 1);
-	entry->tag = tag;
-	entry->tag_len = tag_len;
-	entry->early_closer = FALSE;
+	if (stack->entries->len == 0)
+		return NULL;
+	return &g_array_index (stack->entries, TagEntry, stack->entries->len-1);
+}
+
+static void tag_stack_push (TagStack *stack, const char *tag, int tag_len, gboolean early_closer)
+{
+	TagEntry entry;
+	entry.name = stack->names->len;
+	entry.tag_len = tag_len;
+	entry.early_closer = early_closer;
+	g_string_append_len (stack->names, tag, tag_len);
+	g_string_append_c (stack->names, '\0');
+	g_array_append_val (stack->entries, entry);
+}
+
+static void tag_stack_pop (TagStack *stack)
+{
+	TagEntry *entry = tag_stack_peek (stack);
+	g_string_truncate (stack->names, entry->name);
+	g_array_set_size (stack->entries, stack->entries->len-1);
+}
 
+static gboolean is_early_closer (const char *tag, int tag_len)
+{
+	static const char *early_closers[] = { "p", "li" };
 	unsigned int i;
 	for (i = 0; i < G_N_ELEMENTS (early_closers); i++)
-		if (!g_ascii_strncasecmp (tag->str, early_closers[i], tag_len))
-			entry->early_closer = TRUE;
-	return entry;
+		if (!g_ascii_strncasecmp (tag, early_closers[i], tag_len))
+			return TRUE;
+	return FALSE;
 }
 
-static void
-tag_entry_free (TagEntry *entry)
+static inline void emit_close_tag (GString *outp, const char *tag, int tag_len)
 {
-	if (entry && entry->tag)
-		g_string_free (entry->tag, TRUE);
-	g_free (entry);
+	g_string_append_len (outp, "</", 2);
+	g_string_append_len (outp, tag, tag_len);
+	g_string_append_c (outp, '>');
 }
 
 static void
-emit_unclosed_tags_for (GString *outp, GQueue *tag_queue, const char *tag_str, int tag_len)
+emit_unclosed_tags_for (GString *outp, TagStack *stack, const char *tag_str, int tag_len)
 {
-	gboolean matched = FALSE;
-
-	// top-level tag ...
-	if (g_queue_is_empty (tag_queue))
-		return;
-
-	do {
-		TagEntry *last_entry = (TagEntry *)g_queue_pop_tail (tag_queue);
-		if (!last_entry)
+	TagEntry *last_entry;
+	while ((last_entry = tag_stack_peek (stack))) {
+		const char *last_tag = tag_stack_name (stack, last_entry);
+		gboolean matched = last_entry->tag_len == tag_len &&
+			!g_ascii_strncasecmp (last_tag, tag_str, tag_len);
+		if (!matched)  /* different tag - emit a close ... */
+			emit_close_tag (outp, last_tag, last_entry->tag_len);
+		tag_stack_pop (stack);
+		if (matched)
 			break;
-
-		if (last_entry->tag_len != tag_len ||
-		    g_ascii_strncasecmp (last_entry->tag->str, tag_str, tag_len)) {
-			/* different tag - emit a close ... */
-			g_string_append (outp, "</");
-			g_string_append_len (outp, last_entry->tag->str, last_entry->tag_len);
-			g_string_append_c (outp, '>');
-		} else
-			matched = TRUE;
-
-		tag_entry_free (last_entry);
-	} while (!matched);
+	}
 }
 
 static gboolean
-check_early_close (GString *outp, GQueue *tag_queue, TagEntry *entry)
+check_early_close (GString *outp, TagStack *stack, const char *tag, int tag_len,
+                   gboolean early_closer)
 {
 	TagEntry *last_tag;
 
         // Early closers:
-	if (!entry->early_closer)
+	if (!early_closer)
 		return FALSE;
 
-	last_tag = (TagEntry *) g_queue_peek_tail (tag_queue);
+	last_tag = tag_stack_peek (stack);
 	if (!last_tag || !last_tag->early_closer)
 		return FALSE;
 
-	if (entry->tag_len != last_tag->tag_len ||
-	    g_ascii_strncasecmp (last_tag->tag->str, entry->tag->str, entry->tag_len))
+	if (tag_len != last_tag->tag_len ||
+	    g_ascii_strncasecmp (tag_stack_name (stack, last_tag), tag, tag_len))
 		return FALSE;
 
 	// Emit close & leave last tag on the stack
-
-	g_string_append (outp, "</");
-	g_string_append_len (outp, entry->tag->str, entry->tag_len);
-	g_string_append_c (outp, '>');
-
+	emit_close_tag (outp, tag, tag_len);
 	return TRUE;
 }
 
@@ -103,27 +117,73 @@ typedef struct EntityMap {
 	const gchar *html, *text;
 } EntityMap;
 
-static const EntityMap entities[] = {
+static const EntityMap entities[] = {  // keep sorted, for lookup_entity()
 	{ "nbsp", " " },
 	{ "product", 0 },  // dynamic
 };
 
 static const EntityMap *lookup_entity (const char *html)
 {
-	unsigned int i;
-	for (i = 0; i < sizeof (entities) / sizeof (EntityMap); i++)
-		if (!g_ascii_strncasecmp (html+1, entities[i].html, strlen (entities[i].html)))
-			return entities+i;
+	int lo = 0, hi = G_N_ELEMENTS (entities) - 1;
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		int cmp = g_ascii_strncasecmp (html+1, entities[mid].html,
+		                               strlen (entities[mid].html));
+		if (cmp == 0)
+			return entities+mid;
+		if (cmp < 0)
+			hi = mid-1;
+		else
+			lo = mid+1;
+	}
 	return NULL;
 }
 
+/* Appends the inside of a tag, lower-casing it and adding quotes around
+   un-quoted attribute values. If slash is set, a '/' follows the raw text. */
+static void append_tag_body (GString *tag, const char *raw, int raw_len, gboolean slash)
+{
+	int len = raw_len + (slash ? 1 : 0), k = 0;
+#define RAW(k) ((k) < raw_len ? raw[k] : (k) < len ? '/' : '\0')
+	while (k < len) {
+		char c = RAW (k);
+		if (c == '=') {
+			g_string_append_c (tag, '=');
+			if (RAW (k+1) != '"') {
+				g_string_append_c (tag, '"');
+				for (k++; k < len && !g_ascii_isspace (RAW (k)); k++)
+					g_string_append_c (tag, RAW (k));
+				g_string_append_c (tag, '"');
+			}
+			else {
+				g_string_append_c (tag, '"');
+				for (k += 2; k < len && RAW (k) != '"'; k++)
+					g_string_append_c (tag, RAW (k));
+				if (k < len) {
+					g_string_append_c (tag, '"');
+					k++;
+				}
+			}
+		}
+		else {
+			g_string_append_c (tag, g_ascii_tolower (c));
+			k++;
+		}
+	}
+#undef RAW
+}
+
 // We have to:
 //   + rewrite <br> and <hr> tags
 //   + deal with <a attrib=noquotes>
+// Runs in a single pass over the input, with one output and one scratch buffer.
 gchar *ygutils_convert_to_xhtml (const char *instr)
 {
-	GString *outp = g_string_new ("");
-	GQueue *tag_queue = g_queue_new();
+	GString *outp = g_string_sized_new (strlen (instr) + 64);
+	GString *tag = g_string_sized_new (64);
+	TagStack stack;
+	stack.entries = g_array_new (FALSE, FALSE, sizeof (TagEntry));
+	stack.names = g_string_sized_new (64);
 	int i = 0;
 
 	gboolean allow_space = FALSE, pre_mode = FALSE;
@@ -143,14 +203,13 @@ gchar *ygutils_convert_to_xhtml (const char *instr)
 						i += 2;
 						break;
 					}
+				if (instr[i] == '\0')
+					break;
 				continue;
 			}
 
 			gint j;
 			gboolean is_close = FALSE;
-			gboolean in_tag;
-			int tag_len;
-			GString *tag = g_string_sized_new (20);
 
 			i++;
 			skipSpace (instr, &i);
@@ -163,72 +222,40 @@ gchar *ygutils_convert_to_xhtml (const char *instr)
 			skipSpace (instr, &i);
 
 			// find the tag name piece
-			in_tag = TRUE;
-			tag_len = 0;
-			for (; instr[i] != '>' && instr[i]; i++) {
-				if (in_tag) {
-					if (!g_ascii_isalnum(instr[i]))
-						in_tag = FALSE;
-					else
-						tag_len++;
-				}
-				g_string_append_c (tag, instr[i]);
-			}
+			const char *raw = instr + i;
+			int tag_len = 0;
+			for (; g_ascii_isalnum (instr[i]); i++)
+				tag_len++;
+			for (; instr[i] != '>' && instr[i]; i++) ;
+			int raw_len = (instr + i) - raw;
 
 			// Unmatched tags
-			if (!is_close && tag_len == 2 &&
-			      (!g_ascii_strncasecmp (tag->str, "hr", 2) ||
-			      !g_ascii_strncasecmp (tag->str, "br", 2)) &&
-			      tag->str[tag->len - 1] != '/')
-				g_string_append_c (tag, '/');
+			gboolean slash = !is_close && tag_len == 2 &&
+			      (!g_ascii_strncasecmp (raw, "hr", 2) ||
+			      !g_ascii_strncasecmp (raw, "br", 2)) &&
+			      raw[raw_len - 1] != '/';
 
-			if (!g_ascii_strncasecmp (tag->str, "pre", 3))
+			if (!g_ascii_strncasecmp (raw, "pre", 3))
 				pre_mode = !is_close;
 
 			// Add quoting for un-quoted attributes
-			unsigned int k;
-			for (k = 0; k < tag->len; k++) {
-				if (tag->str[k] == '=') {
-					gboolean unquote = tag->str[k+1] != '"';
-					if (unquote)
-						g_string_insert_c (tag, k+1, '"');
-					else
-						k++;
-					for (k++; tag->str[k]; k++) {
-						if (unquote && g_ascii_isspace (tag->str[k]))
-							break;
-						else if (!unquote && tag->str[k] == '"')
-							break;
-					}
-					if (unquote)
-						g_string_insert_c (tag, k, '"');
-				}
-				else
-					tag->str[k] = g_ascii_tolower (tag->str[k]);
-			}
+			g_string_truncate (tag, 0);
+			append_tag_body (tag, raw, raw_len, slash);
 
 			// Is it an open or close ?
 			j = tag->len - 1;
 
 			while (j > 0 && g_ascii_isspace (tag->str[j])) j--;
 
-			gboolean is_open_close = (tag->str[j] == '/');
+			gboolean is_open_close = (j >= 0 && tag->str[j] == '/');
 			if (is_open_close)
 				; // ignore it
 			else if (is_close)
-				emit_unclosed_tags_for (outp, tag_queue, tag->str, tag_len);
+				emit_unclosed_tags_for (outp, &stack, tag->str, tag_len);
 			else {
-				TagEntry *entry = tag_entry_new (tag, tag_len);
-
-				entry->tag = tag;
-				entry->tag_len = tag_len;
-
-				if (!check_early_close (outp, tag_queue, entry))
-					g_queue_push_tail (tag_queue, entry);
-				else {
-					entry->tag = NULL;
-					tag_entry_free (entry);
-				}
+				gboolean early_closer = is_early_closer (tag->str, tag_len);
+				if (!check_early_close (outp, &stack, tag->str, tag_len, early_closer))
+					tag_stack_push (&stack, tag->str, tag_len, early_closer);
 			}
 
 			g_string_append_c (outp, '<');
@@ -237,10 +264,9 @@ gchar *ygutils_convert_to_xhtml (const char *instr)
 			g_string_append_len (outp, tag->str, tag->len);
 			g_string_append_c (outp, '>');
 
-			if (is_close || is_open_close)
-				g_string_free (tag, TRUE);
-
 			allow_space = is_close;  // don't allow space after opening a tag
+			if (instr[i] == '\0')  // unterminated tag
+				break;
 		}
 
 		else if (instr[i] == '&') {  // Entity
@@ -261,7 +287,7 @@ gchar *ygutils_convert_to_xhtml (const char *instr)
 						break;
 				}
 				if (instr[j] != ';') // entity terminator
-					g_string_append (outp, "&amp;");
+					g_string_append_len (outp, "&amp;", 5);
 				else
 					g_string_append_c (outp, instr[i]);
 			}
@@ -281,8 +307,10 @@ gchar *ygutils_convert_to_xhtml (const char *instr)
 		}
 	}
 
-	emit_unclosed_tags_for (outp, tag_queue, "", 0);
-	g_queue_free (tag_queue);
+	emit_unclosed_tags_for (outp, &stack, "", 0);
+	g_array_free (stack.entries, TRUE);
+	g_string_free (stack.names, TRUE);
+	g_string_free (tag, TRUE);
 	g_string_append (outp, "</body>");
 
 	gchar *ret = g_string_free (outp, FALSE);
@@ -533,19 +561,129 @@ void YGUtils::setPaneRelPosition (GtkWidget *paned, gdouble rel)
 void ygutils_setPaneRelPosition (GtkWidget *paned, gdouble rel)
 { YGUtils::setPaneRelPosition (paned, rel); }
 
+/* Icons are usually loaded over and over (e.g. the same few icons for every
+   row of a table), so decoded pixbufs are kept in a process-wide LRU cache,
+   keyed by absolute path and validated against the file's mtime. */
+
+#include <glib/gstdio.h>
+
+struct PixbufCacheEntry {
+	gchar *path;
+	GdkPixbuf *pixbuf;
+	time_t mtime;
+	gsize bytes;
+	GList *link;  // in the LRU queue
+};
+
+static GHashTable *pixbuf_cache = NULL;
+static GQueue pixbuf_cache_lru = G_QUEUE_INIT;  // head = most recently used
+static gsize pixbuf_cache_bytes = 0, pixbuf_cache_budget = 4*1024*1024;
+static guint pixbuf_cache_hits = 0, pixbuf_cache_misses = 0;
+G_LOCK_DEFINE_STATIC (pixbuf_cache);
+
+static void pixbuf_cache_entry_free (PixbufCacheEntry *entry)
+{
+	g_queue_delete_link (&pixbuf_cache_lru, entry->link);
+	pixbuf_cache_bytes -= entry->bytes;
+	g_object_unref (G_OBJECT (entry->pixbuf));
+	g_free (entry->path);
+	g_free (entry);
+}
+
+static void pixbuf_cache_trim (gsize budget)
+{
+	while (pixbuf_cache_bytes > budget && !g_queue_is_empty (&pixbuf_cache_lru)) {
+		PixbufCacheEntry *entry = (PixbufCacheEntry *) g_queue_peek_tail (&pixbuf_cache_lru);
+		g_hash_table_remove (pixbuf_cache, entry->path);
+	}
+}
+
 GdkPixbuf *YGUtils::loadPixbuf (const std::string &filename)
 {
 	GdkPixbuf *pixbuf = NULL;
 	if (!filename.empty()) {
-		GError *error = 0;
-		pixbuf = gdk_pixbuf_new_from_file (filename.c_str(), &error);
-		if (!pixbuf)
-			yuiWarning() << "Could not load icon: " << filename << "\n"
-			                "Reason: " << error->message << "\n";
+		gchar *path;
+		if (g_path_is_absolute (filename.c_str()))
+			path = g_strdup (filename.c_str());
+		else {
+			gchar *cwd = g_get_current_dir();
+			path = g_build_filename (cwd, filename.c_str(), NULL);
+			g_free (cwd);
+		}
+
+		GStatBuf st;
+		bool can_cache = g_stat (path, &st) == 0;
+
+		G_LOCK (pixbuf_cache);
+		if (!pixbuf_cache)
+			pixbuf_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+				NULL, (GDestroyNotify) pixbuf_cache_entry_free);
+		PixbufCacheEntry *entry = (PixbufCacheEntry *) g_hash_table_lookup (pixbuf_cache, path);
+		if (entry && can_cache && entry->mtime == st.st_mtime) {
+			g_queue_unlink (&pixbuf_cache_lru, entry->link);
+			g_queue_push_head_link (&pixbuf_cache_lru, entry->link);
+			pixbuf = GDK_PIXBUF (g_object_ref (G_OBJECT (entry->pixbuf)));
+			pixbuf_cache_hits++;
+		}
+		else {
+			if (entry)  // stale
+				g_hash_table_remove (pixbuf_cache, path);
+			pixbuf_cache_misses++;
+		}
+		G_UNLOCK (pixbuf_cache);
+
+		if (!pixbuf) {
+			GError *error = 0;
+			pixbuf = gdk_pixbuf_new_from_file (path, &error);
+			if (!pixbuf) {
+				yuiWarning() << "Could not load icon: " << filename << "\n"
+				                "Reason: " << error->message << "\n";
+				g_error_free (error);
+			}
+			else if (can_cache) {
+				gsize bytes = gdk_pixbuf_get_rowstride (pixbuf) * gdk_pixbuf_get_height (pixbuf);
+				G_LOCK (pixbuf_cache);
+				if (bytes <= pixbuf_cache_budget && !g_hash_table_lookup (pixbuf_cache, path)) {
+					entry = g_new (PixbufCacheEntry, 1);
+					entry->path = g_strdup (path);
+					entry->pixbuf = GDK_PIXBUF (g_object_ref (G_OBJECT (pixbuf)));
+					entry->mtime = st.st_mtime;
+					entry->bytes = bytes;
+					g_queue_push_head (&pixbuf_cache_lru, entry);
+					entry->link = g_queue_peek_head_link (&pixbuf_cache_lru);
+					g_hash_table_insert (pixbuf_cache, entry->path, entry);
+					pixbuf_cache_bytes += bytes;
+					pixbuf_cache_trim (pixbuf_cache_budget);
+				}
+				G_UNLOCK (pixbuf_cache);
+			}
+		}
+		g_free (path);
 	}
 	return pixbuf;
 }
 
+GdkPixbuf *ygutils_loadPixbuf (const char *filename)
+{ return YGUtils::loadPixbuf (filename ? filename : ""); }
+
+void YGUtils::setPixbufCacheBudget (gsize bytes)
+{
+	G_LOCK (pixbuf_cache);
+	pixbuf_cache_budget = bytes;
+	if (pixbuf_cache)
+		pixbuf_cache_trim (bytes);
+	G_UNLOCK (pixbuf_cache);
+}
+
+void YGUtils::getPixbufCacheStats (guint *hits, guint *misses, gsize *bytes)
+{
+	G_LOCK (pixbuf_cache);
+	if (hits) *hits = pixbuf_cache_hits;
+	if (misses) *misses = pixbuf_cache_misses;
+	if (bytes) *bytes = pixbuf_cache_bytes;
+	G_UNLOCK (pixbuf_cache);
+}
+
 // Code from Banshee: shades a pixbuf a bit, used e.g. for hover effects
 static inline guchar pixel_clamp (int val)
 { return MAX (0, MIN (255, val)); }
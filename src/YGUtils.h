@@ -47,9 +47,15 @@ namespace YGUtils
 	void setPaneRelPosition (GtkWidget *paned, gdouble rel);
 
 	/* Saves some code and standardizes the error. Returns NULL if failed.
-	   Don't forget to g_object_unref it! */
+	   Don't forget to g_object_unref it! Pixbufs are cached and shared, so
+	   don't modify the returned pixbuf in place. */
 	GdkPixbuf *loadPixbuf (const std::string &fileneme);
 
+	/* Maximum bytes of decoded pixels kept by loadPixbuf() (default: 4MB),
+	   and its usage counters. */
+	void setPixbufCacheBudget (gsize bytes);
+	void getPixbufCacheStats (guint *hits, guint *misses, gsize *bytes);
+
 	/* Shifts colors in a GdkPixbuf. */
 	GdkPixbuf *setOpacity (const GdkPixbuf *src, int opacity, bool touchAlpha);
 
@@ -84,6 +90,7 @@ extern "C" {
 	const char *ygutils_setStockIcon (GtkWidget *button, const char *label,
 	                                  const char *fallbackIcon);
 
+	GdkPixbuf *ygutils_loadPixbuf (const char *filename);
 	GdkPixbuf *ygutils_setOpacity (const GdkPixbuf *src, int opacity, gboolean useAlpha);
 
 	gchar *ygutils_headerize_help (const char *help_text, gboolean *cut);
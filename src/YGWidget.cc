@@ -6,6 +6,7 @@
 #include <yui/Libyui_config.h>
 #include <stdarg.h>
 #include "YGWidget.h"
+#include "YGDialog.h"
 #include "YGUtils.h"
 #include "ygtkratiobox.h"
 #include "YGMacros.h"
@@ -53,6 +54,7 @@ struct YGWidget::Signals
 /* YGWidget follows */
 
 static void min_size_cb (guint *min_width, guint *min_height, gpointer pData);
+static void style_updated_cb (GtkWidget *widget, gpointer pData);
 
 YGWidget::YGWidget(YWidget *ywidget, YWidget *yparent,
                    GType type, const char *property_name, ...)
@@ -82,13 +84,28 @@ void YGWidget::construct (YWidget *ywidget, YWidget *yparent,
 {
 	m_widget = gtkwidget; 
 
-	m_adj_size = ygtk_adj_size_new();
-	g_object_ref_sink (G_OBJECT (m_adj_size));
-	gtk_widget_show (m_adj_size);
-	gtk_container_add (GTK_CONTAINER (m_adj_size), m_widget);
-	ygtk_adj_size_set_min_cb (YGTK_ADJ_SIZE (m_adj_size), min_size_cb, this);
+	if (YGUI::ui()->flatLayout()) {
+		// no wrapper: the border goes into margins, and minimum sizes into
+		// the widget's size request, see doPreferredSize()
+		m_adj_size = m_widget;
+		g_object_ref_sink (G_OBJECT (m_adj_size));
+	}
+	else {
+		m_adj_size = ygtk_adj_size_new();
+		g_object_ref_sink (G_OBJECT (m_adj_size));
+		gtk_widget_show (m_adj_size);
+		gtk_container_add (GTK_CONTAINER (m_adj_size), m_widget);
+		ygtk_adj_size_set_min_cb (YGTK_ADJ_SIZE (m_adj_size), min_size_cb, this);
+	}
 	gtk_widget_show (m_widget);
 
+	m_preferredSizeSerial = 0;
+	m_minSize [YD_HORIZ] = m_minSize [YD_VERT] = 0;
+	m_maxSize [YD_HORIZ] = m_maxSize [YD_VERT] = 0;
+	m_onlyExpand = false;
+	g_signal_connect (G_OBJECT (m_adj_size), "style-updated",
+	                  G_CALLBACK (style_updated_cb), NULL);
+
 	// Split by two so that with another widget it will have full border...
 	setBorder (DEFAULT_BORDER / 2);
 
@@ -141,12 +158,32 @@ void YGWidget::doSetUseBoldFont (bool useBold)
 {
    	PangoWeight weight = useBold ? PANGO_WEIGHT_BOLD : PANGO_WEIGHT_NORMAL;
 	YGUtils::setWidgetFont (getWidget(), PANGO_STYLE_NORMAL, weight, PANGO_SCALE_MEDIUM);
+	invalidatePreferredSizes();
+}
+
+void YGWidget::doSetFunctionKey (int key)
+{
+	invalidateDialogIndex();
 }
 
 void YGWidget::doAddChild (YWidget *ychild, GtkWidget *container)
 {
 	GtkWidget *child = YGWidget::get (ychild)->getLayout();
 	gtk_container_add (GTK_CONTAINER (container), child);
+	invalidatePreferredSizes();
+}
+
+void YGWidget::invalidateDialogIndex()
+{
+	// only the top-most removal of a subtree gets here: deeper widgets are
+	// removed from parents that are already being destroyed
+	for (YWidget *w = m_ywidget; w; w = w->parent()) {
+		YGDialog *dialog = dynamic_cast <YGDialog *> (w);
+		if (dialog) {
+			dialog->invalidateWidgetIndex();
+			break;
+		}
+	}
 }
 
 void YGWidget::doRemoveChild (YWidget *ychild, GtkWidget *container)
@@ -161,14 +198,81 @@ void YGWidget::doRemoveChild (YWidget *ychild, GtkWidget *container)
 		GtkWidget *child = YGWidget::get (ychild)->getLayout();
 		gtk_container_remove (GTK_CONTAINER (container), child);
 	}
+	invalidatePreferredSizes();
 }
 
+/* libyui asks for both dimensions many times per layout pass, so we measure
+   once and keep the result while the serial is unchanged. The serial is bumped
+   by changes we know of (children, labels, fonts, style) and whenever GTK
+   re-measures a top-level YGtkFixed (see YGLayout.cc), which it only does
+   after something queued a resize in it. */
+guint YGWidget::s_sizeSerial = 1;
+
 int YGWidget::doPreferredSize (YUIDimension dimension)
 {
-	// We might want to do some caching here..
-	GtkRequisition req;
-	gtk_widget_get_preferred_size (m_adj_size, &req, NULL);
-	return dimension == YD_HORIZ ? req.width : req.height;
+	if (m_preferredSizeSerial != s_sizeSerial) {
+		GtkRequisition req;
+		if (isFlat())
+			applyMinSize();
+		gtk_widget_get_preferred_size (m_adj_size, &req, NULL);
+		if (isFlat()) {
+			// the rest of what YGtkAdjSize does; the maximum is only honored
+			// by our own layout containers, as GTK has no way to cap a request
+			if (m_maxSize [YD_HORIZ])
+				req.width = MIN (req.width, m_maxSize [YD_HORIZ]);
+			if (m_maxSize [YD_VERT])
+				req.height = MIN (req.height, m_maxSize [YD_VERT]);
+			if (m_onlyExpand) {
+				m_minSize [YD_HORIZ] = req.width;
+				m_minSize [YD_VERT] = req.height;
+			}
+		}
+		m_preferredSize [YD_HORIZ] = req.width;
+		m_preferredSize [YD_VERT] = req.height;
+		m_preferredSizeSerial = s_sizeSerial;
+	}
+	return m_preferredSize [dimension];
+}
+
+void YGWidget::applyMinSize()
+{
+	// unlike YGtkAdjSize's, the size request doesn't include the border
+	int border = gtk_widget_get_margin_top (m_widget);
+	int width = MAX (m_minSize [YD_HORIZ], (int) getMinSize (YD_HORIZ)) - border*2;
+	int height = MAX (m_minSize [YD_VERT], (int) getMinSize (YD_VERT)) - border*2;
+	if (width > 0 || height > 0)  // don't clobber requests set by the widget
+		gtk_widget_set_size_request (m_widget, MAX (width, -1), MAX (height, -1));
+}
+
+void YGWidget::setMinSize (int width, int height)
+{
+	if (isFlat()) {
+		m_minSize [YD_HORIZ] = width;
+		m_minSize [YD_VERT] = height;
+		applyMinSize();
+		invalidatePreferredSizes();
+	}
+	else
+		ygtk_adj_size_set_min (YGTK_ADJ_SIZE (m_adj_size), width, height);
+}
+
+void YGWidget::setMaxSize (int width, int height)
+{
+	if (isFlat()) {
+		m_maxSize [YD_HORIZ] = width;
+		m_maxSize [YD_VERT] = height;
+		invalidatePreferredSizes();
+	}
+	else
+		ygtk_adj_size_set_max (YGTK_ADJ_SIZE (m_adj_size), width, height);
+}
+
+void YGWidget::setOnlyExpand (bool onlyExpand)
+{
+	if (isFlat())
+		m_onlyExpand = onlyExpand;
+	else
+		ygtk_adj_size_set_only_expand (YGTK_ADJ_SIZE (m_adj_size), onlyExpand);
 }
 
 void min_size_cb (guint *min_width, guint *min_height, gpointer pData)
@@ -178,6 +282,9 @@ void min_size_cb (guint *min_width, guint *min_height, gpointer pData)
 	*min_height = pThis->getMinSize (YD_VERT);
 }
 
+void style_updated_cb (GtkWidget *widget, gpointer pData)
+{ YGWidget::invalidatePreferredSizes(); }
+
 #include "ygtkfixed.h"
 
 void YGWidget::doSetSize (int width, int height)
@@ -228,7 +335,17 @@ void YGWidget::unblockSignals()
 { if (m_signals) m_signals->unblock(); }
 
 void YGWidget::setBorder (unsigned int border)
-{ gtk_container_set_border_width (GTK_CONTAINER (m_adj_size), border); }
+{
+	if (isFlat()) {
+		gtk_widget_set_margin_start (m_widget, border);
+		gtk_widget_set_margin_end (m_widget, border);
+		gtk_widget_set_margin_top (m_widget, border);
+		gtk_widget_set_margin_bottom (m_widget, border);
+	}
+	else
+		gtk_container_set_border_width (GTK_CONTAINER (m_adj_size), border);
+	invalidatePreferredSizes();
+}
 
 /* YGLabeledWidget follows */
 
@@ -329,6 +446,7 @@ void YGLabeledWidget::doSetLabel (const std::string &label)
 		gtk_label_set_use_underline (GTK_LABEL (m_label), TRUE);
 	}
 	setLabelVisible (!label.empty());
+	invalidatePreferredSizes();
 }
 
 /* YGScrolledWidget follows */
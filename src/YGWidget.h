@@ -32,12 +32,16 @@ public:
 	virtual bool doSetKeyboardFocus();
 	virtual void doSetEnabled (bool enabled);
 	virtual void doSetUseBoldFont (bool useBold);
+	virtual void doSetFunctionKey (int key);
 	virtual void doAddChild (YWidget *child, GtkWidget *container);
 	virtual void doRemoveChild (YWidget *child, GtkWidget *container);
+	void invalidateDialogIndex();  // call when the widget tree changed
 
 	// layout
 	virtual int doPreferredSize (YUIDimension dimension);
 	virtual void doSetSize (int width, int height);
+	// measured sizes are kept until something may have changed them
+	static void invalidatePreferredSizes() { s_sizeSerial++; }
 
 	// debug
 	const char *getWidgetName() const { return m_ywidget->widgetClass(); }
@@ -47,6 +51,12 @@ public:
 	// aesthetics
 	void setBorder (unsigned int border);  // in pixels
 	virtual unsigned int getMinSize (YUIDimension dim) { return 0; }
+	// size limits, kept by the YGtkAdjSize wrapper or, in flat layout mode
+	// (no wrapper: getLayout() == getWidget()), by doPreferredSize()
+	void setMinSize (int width, int height);
+	void setMaxSize (int width, int height);  // 0 for no limit
+	void setOnlyExpand (bool onlyExpand);  // never ask for less than before
+	bool isFlat() const { return m_adj_size == m_widget; }
 
 protected:
 	// event emission
@@ -71,6 +81,14 @@ protected:
 	// data
 	GtkWidget *m_widget, *m_adj_size;  // associated GtkWidget, and adjustment for borders
 	YWidget *m_ywidget;  // associated YWidget
+
+private:
+	int m_preferredSize [2];  // by YUIDimension
+	guint m_preferredSizeSerial;
+	int m_minSize [2], m_maxSize [2];  // flat layout only
+	bool m_onlyExpand;
+	void applyMinSize();
+	static guint s_sizeSerial;
 };
 
 struct BlockEvents
@@ -95,6 +113,10 @@ struct BlockEvents
 		ParentClass::setEnabled (enabled);                      \
 		doSetEnabled (enabled);                                 \
 	}                                                           \
+	virtual void setFunctionKey (int key) {                     \
+		ParentClass::setFunctionKey (key);                      \
+		doSetFunctionKey (key);                                 \
+	}                                                           \
 	virtual int  preferredWidth()  { return doPreferredSize (YD_HORIZ); } \
 	virtual int  preferredHeight() { return doPreferredSize (YD_VERT); }  \
 	virtual void setSize (int width, int height) { doSetSize (width, height); }
@@ -110,10 +132,12 @@ struct BlockEvents
 	virtual void addChild (YWidget *ychild) {                   \
 		ParentClass::addChild (ychild);                         \
 		doAddChild (ychild, getContainer());                    \
+		invalidateDialogIndex();                                \
 	}                                                           \
 	virtual void removeChild (YWidget *ychild) {                \
 		ParentClass::removeChild (ychild);                      \
 		doRemoveChild (ychild, getContainer());                 \
+		invalidateDialogIndex();                                \
 	}
 
 /* This is a convenience class that allows for a label next to the
@@ -9,6 +9,7 @@
 #include <YUI.h>
 #include <gtk/gtk.h>
 #include "YGUtils.h"
+#include "ygtkfixed.h"
 
 bool testMapKBAccel()
 {
@@ -118,6 +119,72 @@ bool testXHtmlConvert()
 	return true;
 }
 
+static double timeXHtmlConvert (const std::string &in, gchar **out)
+{
+	GTimer *timer = g_timer_new();
+	*out = ygutils_convert_to_xhtml (in.c_str());
+	double elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+	return elapsed;
+}
+
+bool testXHtmlThroughput()
+{
+	fprintf (stderr, "Test HTML->XML throughput \t");
+	const char *paragraph =
+		"<p><b>Release Notes</b><br>Some <i>text</i> &amp; a <a href=http://foo.org/?a=1&amp;b=2>"
+		"link</a> <!-- comment --> with &nbsp; spaces.<ul><li>one<li>two</ul>\n";
+	struct {
+		const char *name;
+		std::string small, large;  // large is four times small
+	} aTests[2];
+
+	aTests[0].name = "text";
+	while (aTests[0].small.size() < 1024*1024)
+		aTests[0].small += paragraph;
+	for (int i = 0; i < 4; i++)
+		aTests[0].large += aTests[0].small;
+
+	// many un-quoted attributes in one tag used to be quadratic
+	aTests[1].name = "attributes";
+	aTests[1].small = "<p";
+	int n = 0;
+	char attr [32];
+	while (aTests[1].small.size() < 256*1024) {
+		g_snprintf (attr, sizeof (attr), " a%d=value", n++);
+		aTests[1].small += attr;
+	}
+	aTests[1].large = aTests[1].small;
+	while (aTests[1].large.size() < 4*aTests[1].small.size()) {
+		g_snprintf (attr, sizeof (attr), " a%d=value", n++);
+		aTests[1].large += attr;
+	}
+	aTests[1].small += ">text";
+	aTests[1].large += ">text";
+
+	for (int i = 0; i < 2; i++) {
+		gchar *small_out, *large_out;
+		double small_time = timeXHtmlConvert (aTests[i].small, &small_out);
+		double large_time = timeXHtmlConvert (aTests[i].large, &large_out);
+		bool valid = testParse (small_out) && testParse (large_out);
+		g_free (small_out);
+		g_free (large_out);
+		if (!valid)
+			return false;
+
+		fprintf (stderr, "%s: %.1f MB/s ", aTests[i].name,
+			aTests[i].large.size() / (1024*1024 * MAX (large_time, 1e-6)));
+		// linear growth would make this 4; allow for timer noise
+		if (large_time > 0.05 && large_time > 10 * small_time) {
+			fprintf (stderr, "\nConversion of '%s' grows super-linearly: %.3fs vs %.3fs\n",
+				aTests[i].name, large_time, small_time);
+			return false;
+		}
+	}
+	fprintf (stderr, "\n");
+	return true;
+}
+
 bool testMarkupEscape()
 {
 	fprintf (stderr, "Test markup escape\t");
@@ -220,15 +287,120 @@ bool testHeaderize()
 	return true;
 }
 
+/* A label that counts how often GTK asks it for its size (cached answers
+   don't reach the vfuncs). */
+typedef struct { GtkLabel parent; } TestLabel;
+typedef struct { GtkLabelClass parent_class; } TestLabelClass;
+G_DEFINE_TYPE (TestLabel, test_label, GTK_TYPE_LABEL)
+
+static int labelMeasures, fixedLayouts;
+
+static void test_label_get_preferred_width (GtkWidget *widget, gint *min, gint *nat)
+{
+	labelMeasures++;
+	GTK_WIDGET_CLASS (test_label_parent_class)->get_preferred_width (widget, min, nat);
+}
+
+static void test_label_get_preferred_height (GtkWidget *widget, gint *min, gint *nat)
+{
+	labelMeasures++;
+	GTK_WIDGET_CLASS (test_label_parent_class)->get_preferred_height (widget, min, nat);
+}
+
+static void test_label_init (TestLabel *label)
+{}
+
+static void test_label_class_init (TestLabelClass *klass)
+{
+	GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+	widget_class->get_preferred_width = test_label_get_preferred_width;
+	widget_class->get_preferred_height = test_label_get_preferred_height;
+}
+
+/* Allocating a YGtkFixed with the geometry it already has, and without
+   anything having re-measured it, must neither lay out nor measure its
+   children again. */
+bool testFixedRelayout (int argc, char **argv)
+{
+	fprintf (stderr, "Test fixed relayout\t");
+	if (!gtk_init_check (&argc, &argv)) {
+		fprintf (stderr, "skipped, no display\n");
+		return true;
+	}
+
+	struct inner {
+		static gint preferred_cb (YGtkFixed *fixed, gpointer data)
+		{ return 100; }
+		// measures the child like YGWidget::doPreferredSize() does for libyui
+		static void set_size_cb (YGtkFixed *fixed, gint width, gint height, gpointer child)
+		{
+			fixedLayouts++;
+			GtkRequisition req;
+			gtk_widget_get_preferred_size ((GtkWidget *) child, &req, NULL);
+			ygtk_fixed_set_child_pos (fixed, (GtkWidget *) child, 0, 0);
+			ygtk_fixed_set_child_size (fixed, (GtkWidget *) child, width, height);
+		}
+	};
+
+	GtkWidget *fixed = GTK_WIDGET (g_object_new (YGTK_TYPE_FIXED, NULL));
+	g_object_ref_sink (G_OBJECT (fixed));
+	GtkWidget *child = GTK_WIDGET (g_object_new (test_label_get_type(), "label", "child", NULL));
+	gtk_container_add (GTK_CONTAINER (fixed), child);
+	ygtk_fixed_setup (YGTK_FIXED (fixed), inner::preferred_cb, inner::preferred_cb,
+	                  inner::set_size_cb, child);
+	gtk_widget_show_all (fixed);
+
+	struct {
+		int width, height;
+		const char *text;  // set on the child before allocating, if any
+		int layouts;  // expected
+		bool measures;
+	} aTests[] = {
+		{ 100, 100, "first", 1, true },
+		{ 100, 100, NULL, 0, false },  // nothing changed
+		{ 120, 100, NULL, 1, false },  // new size, child still measured
+		{ 120, 100, "second", 1, true },  // child queued a resize
+		{ 120, 100, NULL, 0, false },
+		{ 0, 0, NULL, 0, false }
+	};
+	bool ok = true;
+	for (int i = 0; aTests[i].width; i++) {
+		if (aTests[i].text) {
+			gtk_label_set_text (GTK_LABEL (child), aTests[i].text);
+			GtkRequisition req;
+			gtk_widget_get_preferred_size (fixed, &req, NULL);
+		}
+		fixedLayouts = labelMeasures = 0;
+		// otherwise GTK itself skips allocations that change nothing
+		gtk_widget_queue_allocate (fixed);
+		GtkAllocation alloc = { 0, 0, aTests[i].width, aTests[i].height };
+		gtk_widget_size_allocate (fixed, &alloc);
+		if (fixedLayouts != aTests[i].layouts || (labelMeasures > 0) != aTests[i].measures) {
+			fprintf (stderr, "\nAllocation %d: %d layouts, %d child measures; "
+				"expected %d layouts, %s measures\n", i, fixedLayouts, labelMeasures,
+				aTests[i].layouts, aTests[i].measures ? "some" : "no");
+			ok = false;
+			break;
+		}
+		fprintf (stderr, "%d ", i);
+	}
+	fprintf (stderr, "\n");
+	gtk_widget_destroy (fixed);
+	g_object_unref (G_OBJECT (fixed));
+	return ok;
+}
+
 int main (int argc, char **argv)
 {
 	bool bSuccess = true;
 
 	bSuccess &= testMapKBAccel();
 	bSuccess &= testXHtmlConvert();
+	bSuccess &= testXHtmlThroughput();
 	bSuccess &= testMarkupEscape();
 	bSuccess &= testTruncate();
 	bSuccess &= testHeaderize();
+	bSuccess &= testFixedRelayout (argc, argv);
 
 	return !bSuccess;
 }
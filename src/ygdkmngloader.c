@@ -10,7 +10,6 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
-#include <sys/mman.h>
 
 #include <gdk-pixbuf/gdk-pixbuf.h>
 
@@ -69,33 +68,74 @@ static gboolean read_uint32 (DataStream *data, guint32 *value)
 	return TRUE;
 }
 
-static gboolean read_data (DataStream *data, guint32 size, GdkPixbufLoader *loader,
-                           GError **error)
+typedef struct YGdkMngFrame {
+	long offset, size;  // from IHDR to IEND chunks, inclusive
+} YGdkMngFrame;
+
+//** YGdkMngPixbuf
+
+G_DEFINE_TYPE (YGdkMngPixbuf, ygdk_mng_pixbuf, GDK_TYPE_PIXBUF_ANIMATION)
+
+static void ygdk_mng_pixbuf_init (YGdkMngPixbuf *pixbuf)
 {
-	if (data->offset+size > data->size)
-	{
-		g_set_error (error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_CORRUPT_IMAGE,
-		             "Unexpected end of file when reading PNG chunk");
-		return FALSE;
-	}
-	gboolean ret;
-	ret = gdk_pixbuf_loader_write (loader, data->data + data->offset, size, error);
-	data->offset += size;
-	return ret;
+	pixbuf->frames = g_array_new (FALSE, FALSE, sizeof (YGdkMngFrame));
 }
 
-static void image_prepared_cb (GdkPixbufLoader *loader, YGdkMngPixbuf *mng_pixbuf)
+static void ygdk_mng_pixbuf_finalize (GObject *object)
 {
-	GdkPixbuf *pix = gdk_pixbuf_loader_get_pixbuf (loader);
-	mng_pixbuf->frames = g_list_append (mng_pixbuf->frames, pix);
+	YGdkMngPixbuf *pixbuf = YGDK_MNG_PIXBUF (object);
+	int i;
+	for (i = 0; i < YGDK_MNG_FRAMES_WINDOW; i++)
+		if (pixbuf->window[i])
+			g_object_unref (G_OBJECT (pixbuf->window[i]));
+	if (pixbuf->first_frame)
+		g_object_unref (G_OBJECT (pixbuf->first_frame));
+	g_array_free (pixbuf->frames, TRUE);
+	g_free (pixbuf->data);
+	G_OBJECT_CLASS (ygdk_mng_pixbuf_parent_class)->finalize (object);
 }
 
-//** YGdkMngPixbuf
-
-G_DEFINE_TYPE (YGdkMngPixbuf, ygdk_mng_pixbuf, GDK_TYPE_PIXBUF_ANIMATION)
+static GdkPixbuf *ygdk_mng_pixbuf_decode_frame (YGdkMngPixbuf *mng_pixbuf, guint i,
+                                                GError **error)
+{
+	const YGdkMngFrame *frame = &g_array_index (mng_pixbuf->frames, YGdkMngFrame, i);
+	GdkPixbufLoader *loader = gdk_pixbuf_loader_new_with_type ("png", error);
+	if (!loader)
+		return NULL;
+	gdk_pixbuf_loader_set_size (loader, mng_pixbuf->frame_width,
+	                            mng_pixbuf->frame_height);
+
+	const guchar sig[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	GdkPixbuf *pixbuf = NULL;
+	if (gdk_pixbuf_loader_write (loader, sig, 8, error) &&
+	    gdk_pixbuf_loader_write (loader, mng_pixbuf->data + frame->offset, frame->size, error) &&
+	    gdk_pixbuf_loader_close (loader, error)) {
+		pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+		if (pixbuf)
+			g_object_ref (G_OBJECT (pixbuf));
+	}
+	else
+		gdk_pixbuf_loader_close (loader, NULL);
+	g_object_unref (G_OBJECT (loader));
+	return pixbuf;
+}
 
-static void ygdk_mng_pixbuf_init (YGdkMngPixbuf *pixbuf)
+static GdkPixbuf *ygdk_mng_pixbuf_get_frame (YGdkMngPixbuf *mng_pixbuf, guint i)
 {
+	if (i == 0)
+		return mng_pixbuf->first_frame;
+	guint slot = i % YGDK_MNG_FRAMES_WINDOW;
+	if (mng_pixbuf->window[slot] && mng_pixbuf->window_frame[slot] == i)
+		return mng_pixbuf->window[slot];
+
+	GdkPixbuf *pixbuf = ygdk_mng_pixbuf_decode_frame (mng_pixbuf, i, NULL);
+	if (!pixbuf)  // corrupted frame
+		return mng_pixbuf->first_frame;
+	if (mng_pixbuf->window[slot])
+		g_object_unref (G_OBJECT (mng_pixbuf->window[slot]));
+	mng_pixbuf->window[slot] = pixbuf;
+	mng_pixbuf->window_frame[slot] = i;
+	return pixbuf;
 }
 
 gboolean ygdk_mng_pixbuf_is_file_mng (const gchar *filename)
@@ -128,51 +168,47 @@ gboolean ygdk_mng_pixbuf_is_data_mng (const guint8 *raw_data, long size)
 #define SET_ERROR(msg) { error = TRUE; (void) error; \
 	g_set_error (error_msg, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_CORRUPT_IMAGE, msg); }
 
+static GdkPixbufAnimation *ygdk_mng_pixbuf_new (guint8 *raw_data, long size,
+                                                GError **error_msg);
+
 GdkPixbufAnimation *ygdk_mng_pixbuf_new_from_file (const gchar *filename,
                                                    GError **error_msg)
 {
-	gboolean error = FALSE;
-	FILE *file = fopen (filename, "rb");
-	if (!file) {
-		error = TRUE;
-		SET_ERROR ("Could not open specified file")
+	gchar *data;
+	gsize file_size;
+	if (!g_file_get_contents (filename, &data, &file_size, error_msg))
 		return NULL;
-	}
-
-	fseek (file, 0, SEEK_END);
-	long file_size = ftell (file);
-	fseek (file, 0, SEEK_SET);
-
-	GdkPixbufAnimation *mng_pixbuf = 0;
-	guchar *data = mmap (NULL, file_size, PROT_READ, MAP_PRIVATE,
-	                     fileno (file), 0);
-	if (data == MAP_FAILED)
-		SET_ERROR ("Could not map file")
-	else {
-		mng_pixbuf = ygdk_mng_pixbuf_new_from_data (data, file_size, error_msg);
-		munmap (data, file_size);
-	}
-	fclose (file);
-	return mng_pixbuf;
+	return ygdk_mng_pixbuf_new ((guint8 *) data, file_size, error_msg);
 }
 
 GdkPixbufAnimation *ygdk_mng_pixbuf_new_from_data (const guint8 *raw_data, long size,
                                                    GError **error_msg)
+{
+	guint8 *data = g_malloc (size);
+	memcpy (data, raw_data, size);
+	return ygdk_mng_pixbuf_new (data, size, error_msg);
+}
+
+// takes ownership of raw_data: the frames are only decoded as they are shown
+static GdkPixbufAnimation *ygdk_mng_pixbuf_new (guint8 *raw_data, long size,
+                                                GError **error_msg)
 {
 	DataStream data = data_stream_constructor (raw_data, size);
 
 	gboolean error = FALSE;
 	if (!read_signature (&data)) {
 		SET_ERROR ("Not a MNG file")
+		g_free (raw_data);
 		return NULL;
 	}
 
 	YGdkMngPixbuf *mng_pixbuf = g_object_new (YGDK_TYPE_MNG_PIXBUF, NULL);
+	mng_pixbuf->data = raw_data;
 	mng_pixbuf->iteration_max = 0x7fffffff;
 
 	guint32 chunk_size, chunk_id;
 	long chunk_offset;
-	GdkPixbufLoader *loader = NULL;  /* currently loading... */
+	YGdkMngFrame frame = { -1, 0 };  /* currently in a PNG stream if offset != -1 */
 	gboolean first_read = TRUE;
 
     do {
@@ -191,7 +227,7 @@ GdkPixbufAnimation *ygdk_mng_pixbuf_new_from_data (const guint8 *raw_data, long
 		}
 
 		// not currently reading a PNG stream 
-		if (!loader)
+		if (frame.offset == -1)
 		{
 			switch (chunk_id)
 			{
@@ -222,20 +258,7 @@ GdkPixbufAnimation *ygdk_mng_pixbuf_new_from_data (const guint8 *raw_data, long
 						SET_ERROR ("MHDR chunk must be 28 bytes long")
 					break;
 				case MNG_UINT_IHDR:
-					loader = gdk_pixbuf_loader_new_with_type ("png", NULL);
-					g_signal_connect (G_OBJECT (loader), "area-prepared",
-					                  G_CALLBACK (image_prepared_cb), mng_pixbuf);
-					gdk_pixbuf_loader_set_size (loader, mng_pixbuf->frame_width,
-					                            mng_pixbuf->frame_height);
-
-					{
-						const guchar sig[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
-						if(!gdk_pixbuf_loader_write (loader, sig, 8, error_msg))
-						{
-							error = TRUE;
-							break;
-						}
-					}
+					frame.offset = data.offset - 8;
 					break;
 				case MNG_UINT_TERM:
 					if (chunk_size > 1)
@@ -260,11 +283,6 @@ GdkPixbufAnimation *ygdk_mng_pixbuf_new_from_data (const guint8 *raw_data, long
 				case MNG_UINT_BACK:
 					// TODO:
 					break;
-				case MNG_UINT_IDAT:
-				case MNG_UINT_IEND:
-					if (loader != NULL)
-						SET_ERROR ("Corrupted PNG chunk closures")
-					break;
 				case MNG_UINT_MEND:
 				default:
 					break;
@@ -274,20 +292,19 @@ GdkPixbufAnimation *ygdk_mng_pixbuf_new_from_data (const guint8 *raw_data, long
 		if (error)
 			break;
 
-		// loading a PNG stream
-		if (loader)
+		// within a PNG stream: just note where it ends
+		if (frame.offset != -1)
 		{
-			data.offset -= 8;
-			if (!read_data (&data, chunk_size+8+4, loader, error_msg))
-				error = TRUE;
-			else if (chunk_id == MNG_UINT_IEND)
+			if (chunk_offset > data.size)
 			{
-				if (!gdk_pixbuf_loader_close (loader, error_msg))
-				{
-					error = TRUE;
-					break;
-				}
-				loader = NULL;
+				SET_ERROR ("Unexpected end of file when reading PNG chunk")
+				break;
+			}
+			if (chunk_id == MNG_UINT_IEND)
+			{
+				frame.size = chunk_offset - frame.offset;
+				g_array_append_val (mng_pixbuf->frames, frame);
+				frame.offset = -1;
 			}
 		}
 
@@ -295,6 +312,14 @@ GdkPixbufAnimation *ygdk_mng_pixbuf_new_from_data (const guint8 *raw_data, long
 		first_read = FALSE;
     } while (chunk_id != MNG_UINT_MEND && !error);
 
+	// decode the first frame right away, to validate the image
+	if (!error && mng_pixbuf->frames->len > 0)
+	{
+		mng_pixbuf->first_frame = ygdk_mng_pixbuf_decode_frame (mng_pixbuf, 0, error_msg);
+		if (!mng_pixbuf->first_frame)
+			error = TRUE;
+	}
+
 	if (error)
 	{
 		g_object_unref (G_OBJECT (mng_pixbuf));
@@ -308,13 +333,13 @@ GdkPixbufAnimation *ygdk_mng_pixbuf_new_from_data (const guint8 *raw_data, long
 static gboolean ygdk_mng_pixbuf_is_static_image (GdkPixbufAnimation *anim)
 {
 	YGdkMngPixbuf *mng_anim = YGDK_MNG_PIXBUF (anim);
-	return g_list_length (mng_anim->frames) == 1;
+	return mng_anim->frames->len == 1;
 }
 
 static GdkPixbuf *ygdk_mng_pixbuf_get_static_image (GdkPixbufAnimation *anim)
 {
 	YGdkMngPixbuf *mng_anim = YGDK_MNG_PIXBUF (anim);
-	return g_list_nth_data (mng_anim->frames, 0);
+	return mng_anim->first_frame;
 }
 
 static void ygdk_mng_pixbuf_get_size (GdkPixbufAnimation *anim, int *width, int *height)
@@ -337,6 +362,9 @@ static void ygdk_mng_pixbuf_class_init (YGdkMngPixbufClass *klass)
 {
 	ygdk_mng_pixbuf_parent_class = g_type_class_peek_parent (klass);
 
+	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+	gobject_class->finalize = ygdk_mng_pixbuf_finalize;
+
 	GdkPixbufAnimationClass *pixbuf_class = GDK_PIXBUF_ANIMATION_CLASS (klass);
 	pixbuf_class->is_static_image  = ygdk_mng_pixbuf_is_static_image;
 	pixbuf_class->get_static_image  = ygdk_mng_pixbuf_get_static_image;
@@ -355,7 +383,7 @@ static void ygdk_mng_pixbuf_iter_init (YGdkMngPixbufIter *iter)
 static GdkPixbuf *ygdk_mng_pixbuf_iter_get_pixbuf (GdkPixbufAnimationIter *iter)
 {
 	YGdkMngPixbufIter *mng_iter = YGDK_MNG_PIXBUF_ITER (iter);
-	return g_list_nth_data (mng_iter->mng_pixbuf->frames, mng_iter->cur_frame);	
+	return ygdk_mng_pixbuf_get_frame (mng_iter->mng_pixbuf, mng_iter->cur_frame);
 }
 
 static gboolean ygdk_mng_pixbuf_iter_on_currently_loading_frame (GdkPixbufAnimationIter *iter)
@@ -367,7 +395,7 @@ static int ygdk_mng_pixbuf_iter_get_delay_time (GdkPixbufAnimationIter *iter)
 {
 	YGdkMngPixbufIter *mng_iter = YGDK_MNG_PIXBUF_ITER (iter);
 	int delay = 1000.0 / mng_iter->mng_pixbuf->ticks_per_second;
-	if (mng_iter->cur_frame == g_list_length (mng_iter->mng_pixbuf->frames)-1)
+	if (mng_iter->cur_frame == (int) mng_iter->mng_pixbuf->frames->len-1)
 		delay += mng_iter->mng_pixbuf->last_frame_delay;
 	return delay;
 }
@@ -377,11 +405,11 @@ static gboolean ygdk_mng_pixbuf_iter_advance (GdkPixbufAnimationIter *iter,
 {
 	YGdkMngPixbufIter *mng_iter = YGDK_MNG_PIXBUF_ITER (iter);
 	YGdkMngPixbuf *mng_pixbuf = mng_iter->mng_pixbuf;
-	if (!mng_pixbuf->frames)
+	if (!mng_pixbuf->frames->len)
 		return FALSE;
 
 	gboolean can_advance = TRUE;
-	int frames_len = g_list_length (mng_pixbuf->frames);
+	int frames_len = mng_pixbuf->frames->len;
 	if (mng_iter->cur_frame+1 == frames_len)
 	{
 		if (mng_pixbuf->iteration_max == 0x7fffffff || 
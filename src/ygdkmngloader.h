@@ -27,12 +27,19 @@ G_BEGIN_DECLS
 #define YGDK_MNG_PIXBUF_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  \
                                          YGK_TYPE_MNG_PIXBUF, YGdkMngPixbufClass))
 
+/* Frames are only decoded when shown; we keep the last few around. */
+#define YGDK_MNG_FRAMES_WINDOW 3
+
 typedef struct YGdkMngPixbuf
 {
 	GdkPixbufAnimation parent;
 
 	// private: (use GdkPixbufAnimation API)
-	GList *frames;  // of GdkPixbufs
+	guint8 *data;  // the whole file
+	GArray *frames;  // of YGdkMngFrame, where each PNG stream lies in data
+	GdkPixbuf *first_frame;  // always decoded
+	GdkPixbuf *window[YGDK_MNG_FRAMES_WINDOW];  // by frame % window size
+	guint window_frame[YGDK_MNG_FRAMES_WINDOW];
 	// MHDR header
 	guint32 frame_width, frame_height, ticks_per_second;
 	// TERM header
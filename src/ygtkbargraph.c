@@ -48,12 +48,14 @@ void ygtk_bar_graph_create_entries (YGtkBarGraph *bar, guint entries)
 
 	// Remove the ones in excess
 	guint i;
-	for (i = entries; i < g_list_length (box->children); i++)
-		gtk_container_remove (GTK_CONTAINER (box),
-				(GtkWidget*) g_list_nth_data (box->children, i));
+	while (box->children->len > entries) {
+		YGtkRatioBoxChild *child =
+			g_ptr_array_index (box->children, box->children->len-1);
+		gtk_container_remove (GTK_CONTAINER (box), child->widget);
+	}
 
 	// Add new ones, if missing
-	for (i = g_list_length (box->children); i < entries; i++) {
+	for (i = box->children->len; i < entries; i++) {
 		GtkWidget *label = ygtk_colored_label_new();
 		gtk_label_set_justify (GTK_LABEL (label), GTK_JUSTIFY_CENTER);
 
@@ -68,7 +70,7 @@ void ygtk_bar_graph_create_entries (YGtkBarGraph *bar, guint entries)
 static GtkWidget *ygtk_bar_graph_get_label (YGtkBarGraph *bar, int index, GtkWidget **b)
 {
         YGtkRatioBox *hbox = YGTK_RATIO_BOX (gtk_bin_get_child(GTK_BIN (bar)));
-	GtkWidget *box = ((YGtkRatioBoxChild *) g_list_nth_data (hbox->children, index))->widget;
+	GtkWidget *box = ((YGtkRatioBoxChild *) g_ptr_array_index (hbox->children, index))->widget;
 	if (b) *b = box;
 	return gtk_bin_get_child (GTK_BIN (box));
 }
@@ -12,6 +12,9 @@
 
 G_DEFINE_TYPE (YGtkFixed, ygtk_fixed, GTK_TYPE_CONTAINER)
 
+// children carry their record, so positioning them needs no list walk
+static GQuark child_quark;
+
 static void ygtk_fixed_init (YGtkFixed *fixed)
 {
         gtk_widget_set_has_window(GTK_WIDGET(fixed), FALSE);
@@ -28,14 +31,12 @@ void ygtk_fixed_setup (YGtkFixed *fixed, YGtkPreferredWidth cb1, YGtkPreferredHe
 
 static YGtkFixedChild *ygtk_fixed_get_child (YGtkFixed *fixed, GtkWidget *widget)
 {
-	GSList *i;
-	for (i = fixed->children; i; i = i->next) {
-		YGtkFixedChild *child = i->data;
-		if (child->widget == widget)
-			return child;
+	YGtkFixedChild *child = g_object_get_qdata (G_OBJECT (widget), child_quark);
+	if (!child || gtk_widget_get_parent (widget) != GTK_WIDGET (fixed)) {
+		g_warning ("YGtkFixed: could not find child.");
+		return NULL;
 	}
-	g_warning ("YGtkFixed: could not find child.");
-	return NULL;
+	return child;
 }
 
 void ygtk_fixed_set_child_pos (YGtkFixed *fixed, GtkWidget *widget, gint x, gint y)
@@ -58,25 +59,24 @@ static void ygtk_fixed_add (GtkContainer *container, GtkWidget *widget)
 	YGtkFixedChild *child = g_new0 (YGtkFixedChild, 1);
 	child->widget = widget;
 	child->width = child->height = 50;
-	fixed->children = g_slist_append (fixed->children, child);
+	g_queue_push_tail (&fixed->children, child);
+	child->link = fixed->children.tail;
+	g_object_set_qdata (G_OBJECT (widget), child_quark, child);
 	gtk_widget_set_parent (widget, GTK_WIDGET (fixed));
 }
 
 static void ygtk_fixed_remove (GtkContainer *container, GtkWidget *widget)
 {
 	YGtkFixed *fixed = YGTK_FIXED (container);
-	GSList *i;
-	for (i = fixed->children; i; i = i->next) {
-		YGtkFixedChild *child = i->data;
-		if (child->widget == widget) {
-			gboolean was_visible = gtk_widget_get_visible (widget);
-			gtk_widget_unparent (widget);
-			fixed->children = g_slist_delete_link (fixed->children, i);
-			g_free (child);
-			if (was_visible)
-				gtk_widget_queue_resize (GTK_WIDGET (container));
-			break;
-		}
+	YGtkFixedChild *child = g_object_get_qdata (G_OBJECT (widget), child_quark);
+	if (child && gtk_widget_get_parent (widget) == GTK_WIDGET (fixed)) {
+		gboolean was_visible = gtk_widget_get_visible (widget);
+		g_object_set_qdata (G_OBJECT (widget), child_quark, NULL);
+		gtk_widget_unparent (widget);
+		g_queue_delete_link (&fixed->children, child->link);
+		g_free (child);
+		if (was_visible)
+			gtk_widget_queue_resize (GTK_WIDGET (container));
 	}
 }
 
@@ -85,7 +85,7 @@ static void ygtk_fixed_forall (GtkContainer *container, gboolean include_interna
 {
 	g_return_if_fail (callback != NULL);
 	YGtkFixed *fixed = YGTK_FIXED (container);
-	GSList *i = fixed->children;
+	GList *i = fixed->children.head;
 	while (i) {
 		YGtkFixedChild *child = i->data;
 		i = i->next;  // current node might get removed...
@@ -99,6 +99,7 @@ ygtk_fixed_get_preferred_width (GtkWidget *widget,
                                gint      *natural_width)
 {
 	YGtkFixed *fixed = YGTK_FIXED (widget);
+	fixed->measured = TRUE;
 	*natural_width = *minimum_width =
 		fixed->preferred_width_cb (fixed, fixed->data);
 }
@@ -109,30 +110,45 @@ ygtk_fixed_get_preferred_height (GtkWidget *widget,
                                 gint      *natural_height)
 {
 	YGtkFixed *fixed = YGTK_FIXED (widget);
+	fixed->measured = TRUE;
 	*natural_height = *minimum_height =
 		fixed->preferred_height_cb (fixed, fixed->data);
 }
 
+/* Children were measured by libyui when laying out, through set_size_cb,
+   so we just hand them the geometry it stored with us. GTK only measures us
+   again after something inside queued a resize; until then, and while our
+   size stays the same, the libyui layout and the children are still good. */
 static void ygtk_fixed_size_allocate (GtkWidget *widget, GtkAllocation *allocation)
 {
 	YGtkFixed *fixed = YGTK_FIXED (widget);
-	fixed->set_size_cb (fixed, allocation->width, allocation->height, fixed->data);
+	gboolean relayout = fixed->measured || allocation->width != fixed->alloc_width ||
+		allocation->height != fixed->alloc_height;
+	if (relayout) {
+		fixed->set_size_cb (fixed, allocation->width, allocation->height, fixed->data);
+		fixed->alloc_width = allocation->width;
+		fixed->alloc_height = allocation->height;
+		fixed->measured = FALSE;
+	}
 
-	GSList *i;
-	for (i = fixed->children; i; i = i->next) {
+	gboolean rtl = gtk_widget_get_default_direction() == GTK_TEXT_DIR_RTL;
+	GList *i;
+	for (i = fixed->children.head; i; i = i->next) {
 		YGtkFixedChild *child = i->data;
 		int x = child->x;
-		if (gtk_widget_get_default_direction() == GTK_TEXT_DIR_RTL)
+		if (rtl)
 			x = allocation->width - (child->x + child->width);
 		x += allocation->x;
 		int y = child->y + allocation->y;
 		GtkAllocation child_alloc =
 			{ x, y, MAX (child->width, 1), MAX (child->height, 1) };
 
-		GtkRequisition min_child_req;
-		GtkRequisition nat_child_req;
-		gtk_widget_get_preferred_size (child->widget, &min_child_req, &nat_child_req);
-
+		// a child that queued a resize has re-measured us, so relayout is set
+		if (!relayout && child->alloc.x == child_alloc.x &&
+		    child->alloc.y == child_alloc.y && child->alloc.width == child_alloc.width &&
+		    child->alloc.height == child_alloc.height)
+			continue;
+		child->alloc = child_alloc;
 		gtk_widget_size_allocate (child->widget, &child_alloc);
 	}
 	GTK_WIDGET_CLASS (ygtk_fixed_parent_class)->size_allocate (widget, allocation);
@@ -144,6 +160,7 @@ static GType ygtk_fixed_child_type (GtkContainer *container)
 static void ygtk_fixed_class_init (YGtkFixedClass *klass)
 {
 	ygtk_fixed_parent_class = g_type_class_peek_parent (klass);
+	child_quark = g_quark_from_static_string ("ygtk-fixed-child");
 
 	GtkContainerClass *container_class = GTK_CONTAINER_CLASS (klass);
 	container_class->add = ygtk_fixed_add;
@@ -34,11 +34,13 @@ struct _YGtkFixed
 {
 	GtkContainer parent;
 	// private (read-only):
-	GSList *children;
+	GQueue children;  // of YGtkFixedChild, in order of addition
 	YGtkPreferredWidth preferred_width_cb;
 	YGtkPreferredHeight preferred_height_cb;
 	YGtkSetSize set_size_cb;
 	gpointer data;
+	gboolean measured;  // re-measured since the last allocation
+	gint alloc_width, alloc_height;  // size last passed to set_size_cb
 };
 
 struct _YGtkFixedClass
@@ -52,6 +54,8 @@ typedef struct _YGtkFixedChild
 	// members
 	// post-pone all position and size setting, to avoid unnecessary work
 	gint x, y, width, height;
+	GtkAllocation alloc;  // last one given to the widget
+	GList *link;  // node in YGtkFixed.children
 } YGtkFixedChild;
 
 GType ygtk_fixed_get_type (void) G_GNUC_CONST;
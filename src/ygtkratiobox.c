@@ -11,10 +11,21 @@
 
 G_DEFINE_ABSTRACT_TYPE (YGtkRatioBox, ygtk_ratio_box, GTK_TYPE_CONTAINER)
 
+// children carry their packing info, so we needn't search for it
+static GQuark child_quark;
+
 static void ygtk_ratio_box_init (YGtkRatioBox *box)
 {
         gtk_widget_set_has_window (GTK_WIDGET(box), FALSE);
 	gtk_widget_set_redraw_on_allocate (GTK_WIDGET (box), FALSE);
+	box->children = g_ptr_array_new();
+}
+
+static void ygtk_ratio_box_finalize (GObject *object)
+{
+	YGtkRatioBox *box = YGTK_RATIO_BOX (object);
+	g_ptr_array_free (box->children, TRUE);
+	G_OBJECT_CLASS (ygtk_ratio_box_parent_class)->finalize (object);
 }
 
 static GType ygtk_ratio_box_child_type (GtkContainer* container)
@@ -27,7 +38,8 @@ void ygtk_ratio_box_pack (YGtkRatioBox *box, GtkWidget *child, gfloat ratio)
 	child_info->widget = child;
 	child_info->ratio = ratio;
 
-	box->children = g_list_append (box->children, child_info);
+	g_ptr_array_add (box->children, child_info);
+	g_object_set_qdata (G_OBJECT (child), child_quark, child_info);
 
 	gtk_widget_freeze_child_notify (child);
 	gtk_widget_set_parent (child, GTK_WIDGET (box));
@@ -36,16 +48,9 @@ void ygtk_ratio_box_pack (YGtkRatioBox *box, GtkWidget *child, gfloat ratio)
 
 static YGtkRatioBoxChild *ygtk_ratio_get_child_info (YGtkRatioBox *box, GtkWidget *child)
 {
-	YGtkRatioBoxChild *i = NULL;
-	GList *list;
-	for (list = box->children; list; list = list->next) {
-		i = (YGtkRatioBoxChild*) list->data;
-		if (i->widget == child)
-			break;
-	}
-	if (!list)
+	if (gtk_widget_get_parent (child) != GTK_WIDGET (box))
 		return NULL;
-	return i;
+	return g_object_get_qdata (G_OBJECT (child), child_quark);
 }
 
 static void ygtk_ratio_box_add (GtkContainer *container, GtkWidget *child)
@@ -56,22 +61,17 @@ static void ygtk_ratio_box_add (GtkContainer *container, GtkWidget *child)
 static void ygtk_ratio_box_remove (GtkContainer *container, GtkWidget *widget)
 {
 	YGtkRatioBox* box = YGTK_RATIO_BOX (container);
+	YGtkRatioBoxChild *box_child = ygtk_ratio_get_child_info (box, widget);
+	if (box_child) {
+		gboolean was_visible = gtk_widget_get_visible (widget);
+		g_object_set_qdata (G_OBJECT (widget), child_quark, NULL);
+		gtk_widget_unparent (widget);
 
-	GList* child = box->children;
-	for (child = box->children; child; child = child->next) {
-		YGtkRatioBoxChild *box_child = (YGtkRatioBoxChild*) child->data;
-		if (box_child->widget == widget) {
-			gboolean was_visible = gtk_widget_get_visible (widget);
-			gtk_widget_unparent (widget);
-
-			box->children = g_list_remove_link (box->children, child);
-			g_list_free (child);
-			g_free (box_child);
+		g_ptr_array_remove (box->children, box_child);
+		g_free (box_child);
 
-			if (was_visible)
-				gtk_widget_queue_resize (GTK_WIDGET (container));
-			break;
-		}
+		if (was_visible)
+			gtk_widget_queue_resize (GTK_WIDGET (container));
 	}
 }
 
@@ -82,11 +82,13 @@ static void ygtk_ratio_box_forall (GtkContainer *container, gboolean include_int
 
 	YGtkRatioBox* box = YGTK_RATIO_BOX (container);
 
-	GList* children = box->children;
-	while (children) {
-		YGtkRatioBoxChild* child = (YGtkRatioBoxChild*) children->data;
-		children = children->next;
+	guint i = 0;
+	while (i < box->children->len) {
+		YGtkRatioBoxChild* child = g_ptr_array_index (box->children, i);
 		(* callback) (child->widget, callback_data);
+		// current child might get removed...
+		if (i < box->children->len && g_ptr_array_index (box->children, i) == child)
+			i++;
 	}
 }
 
@@ -101,15 +103,14 @@ static void ygtk_ratio_box_get_preferred_size (GtkWidget      *widget,
 
 	YGtkRatioBox* box = YGTK_RATIO_BOX (widget);
 	gint children_nb = 0;
-	GList *i;
-	for (i = box->children; i; i = i->next) {
-		YGtkRatioBoxChild* child = i->data;
+	guint i;
+	for (i = 0; i < box->children->len; i++) {
+		YGtkRatioBoxChild* child = g_ptr_array_index (box->children, i);
 		if (!gtk_widget_get_visible (child->widget))
 			continue;
 
 		GtkRequisition min_child_req;
-                GtkRequisition nat_child_req;
-		gtk_widget_get_preferred_size (child->widget, &min_child_req, &nat_child_req);
+		gtk_widget_get_preferred_size (child->widget, &min_child_req, NULL);
 		if (orientation == GTK_ORIENTATION_HORIZONTAL)
 			requisition->height = MAX (requisition->height, min_child_req.height);
 		else
@@ -135,15 +136,17 @@ static void ygtk_ratio_box_size_allocate (GtkWidget     *widget,
 
 	gfloat ratios_sum = 0;
 	gint children_nb = 0;
+	gint last_visible = -1;
 
-	GList* i;
-	for (i = box->children; i; i = i->next) {
-		YGtkRatioBoxChild* child = i->data;
+	guint i;
+	for (i = 0; i < box->children->len; i++) {
+		YGtkRatioBoxChild* child = g_ptr_array_index (box->children, i);
 		if (!gtk_widget_get_visible (child->widget))
 			continue;
 
 		ratios_sum += child->ratio;
 		children_nb++;
+		last_visible = i;
 	}
 
 	gint spacing = children_nb ? box->spacing*(children_nb-1) : 0;
@@ -159,13 +162,15 @@ static void ygtk_ratio_box_size_allocate (GtkWidget     *widget,
 		length = height - spacing;
 	gint child_pos = 0;
 
-	for (i = box->children; i; i = i->next) {
-		YGtkRatioBoxChild* child = i->data;
+	// GTK keeps the children's requests from our own measuring; they aren't
+	// needed to split the length by ratio
+	for (i = 0; i < box->children->len; i++) {
+		YGtkRatioBoxChild* child = g_ptr_array_index (box->children, i);
 		if (!gtk_widget_get_visible (child->widget))
 			continue;
 
 		gint child_length = (child->ratio * length) / ratios_sum;
-		if (!i->next)  // last takes rest (any residual length)
+		if ((gint) i == last_visible)  // last takes rest (any residual length)
 			child_length = length - child_pos;
 
 		GtkAllocation child_alloc;
@@ -182,10 +187,6 @@ static void ygtk_ratio_box_size_allocate (GtkWidget     *widget,
 			child_alloc.height = child_length;
 		}
 
-		GtkRequisition min_child_req;
-		GtkRequisition nat_child_req;
-		gtk_widget_get_preferred_size (child->widget, &min_child_req, &nat_child_req);
-
 		child_alloc.width = MAX (child_alloc.width, 1);
 		child_alloc.height = MAX (child_alloc.height, 1);
 
@@ -201,6 +202,7 @@ void ygtk_ratio_box_set_child_packing (YGtkRatioBox *box, GtkWidget *child, gflo
 	if (child_info) {
 		gtk_widget_freeze_child_notify (child);
 		child_info->ratio = ratio;
+		// the ratio only matters when allocating, so there is no size to forget
 		if (gtk_widget_get_visible (child) && gtk_widget_get_visible (GTK_WIDGET(box)))
 			gtk_widget_queue_resize (child);
 
@@ -216,6 +218,10 @@ void ygtk_ratio_box_set_spacing (YGtkRatioBox *box, guint spacing)
 static void ygtk_ratio_box_class_init (YGtkRatioBoxClass *klass)
 {
 	ygtk_ratio_box_parent_class = (GtkContainerClass*) g_type_class_peek_parent (klass);
+	child_quark = g_quark_from_static_string ("ygtk-ratio-box-child");
+
+	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+	gobject_class->finalize = ygtk_ratio_box_finalize;
 
 	GtkContainerClass *container_class = GTK_CONTAINER_CLASS (klass);
 	container_class->add = ygtk_ratio_box_add;
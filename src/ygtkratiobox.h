@@ -28,7 +28,7 @@ typedef struct _YGtkRatioBox
 	GtkContainer parent;
 
 	// private (read-only):
-	GList *children;
+	GPtrArray *children;  // of YGtkRatioBoxChild, in packing order
 	guint spacing;
 } YGtkRatioBox;
 
@@ -21,24 +21,47 @@ G_DEFINE_TYPE (YGtkRichText, ygtk_rich_text, YGTK_TYPE_TEXT_VIEW)
 static guint link_clicked_signal;
 static GdkColor link_color = { 0, 0, 0, 0xeeee };
 
+typedef struct RTLink {
+	gint start, end;  // in chars
+	gchar *target;
+} RTLink;
+
 // utilities
-// Looks at all tags covering the position of iter in the text view,
-// and returns the link the text points to, in case that text is a link.
+// Returns the link the text at iter points to, in case that text is a link.
 static const char *get_link_at_iter (GtkTextView *text_view, GtkTextIter *iter)
 {
-	char *link = NULL;
-	GSList *tags = gtk_text_iter_get_tags (iter), *tagp;
-	for (tagp = tags; tagp != NULL; tagp = tagp->next) {
-		GtkTextTag *tag = (GtkTextTag*) tagp->data;
-		link = (char*) g_object_get_data (G_OBJECT (tag), "link");
-		if (link)
-			break;
+	GArray *links = YGTK_RICH_TEXT (text_view)->links;
+	if (!links)
+		return NULL;
+	gint offset = gtk_text_iter_get_offset (iter);
+
+	// links are sorted by start; find the last one starting before offset
+	gint lo = 0, hi = (gint) links->len - 1, found = -1;
+	while (lo <= hi) {
+		gint mid = (lo + hi) / 2;
+		if (g_array_index (links, RTLink, mid).start <= offset) {
+			found = mid;
+			lo = mid + 1;
+		}
+		else
+			hi = mid - 1;
+	}
+	if (found >= 0) {
+		RTLink *link = &g_array_index (links, RTLink, found);
+		if (offset < link->end)
+			return link->target;
 	}
+	return NULL;
+}
 
-	if (tags)
-		g_slist_free (tags);
-	return link;
+static void clear_links (YGtkRichText *rtext)
+{
+	guint i;
+	for (i = 0; i < rtext->links->len; i++)
+		g_free (g_array_index (rtext->links, RTLink, i).target);
+	g_array_set_size (rtext->links, 0);
 }
+
 static const char *get_link (GtkTextView *text_view, gint win_x, gint win_y)
 {
 	gint buffer_x, buffer_y;
@@ -117,6 +140,8 @@ void ygtk_rich_text_init (YGtkRichText *rtext)
 	g_object_ref (rtext->hand_cursor);
 
 	gtk_widget_style_get (widget, "link_color", &link_color, NULL);
+	rtext->style_tags = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	rtext->links = g_array_new (FALSE, FALSE, sizeof (RTLink));
 	g_signal_connect (tview, "event-after",
 	                  G_CALLBACK (event_after), NULL);
 
@@ -158,12 +183,25 @@ void ygtk_rich_text_init (YGtkRichText *rtext)
 		"foreground", "#000000", NULL);
 }
 
+static void rt_search_check_visible (YGtkRichText *rtext);
+static void rt_search_reset (YGtkRichText *rtext);
+
 static void ygtk_rich_text_destroy (GtkWidget *widget)
 {
 	// destroy can be called multiple times, and we must ref only once
 	YGtkRichText *rtext = YGTK_RICH_TEXT (widget);
 	g_object_unref (rtext->hand_cursor);
 	ygtk_rich_text_set_background (rtext, NULL);
+	if (rtext->style_tags) {
+		g_hash_table_destroy (rtext->style_tags);
+		rtext->style_tags = NULL;
+	}
+	if (rtext->links) {
+		clear_links (rtext);
+		g_array_free (rtext->links, TRUE);
+		rtext->links = NULL;
+	}
+	rt_search_reset (rtext);
 	GTK_WIDGET_CLASS (ygtk_rich_text_parent_class)->destroy(widget);
 }
 
@@ -232,11 +270,277 @@ static gboolean ygtk_rich_text_draw (GtkWidget *widget, cairo_t *cr)
 	gboolean ret;
 	ret = GTK_WIDGET_CLASS (ygtk_rich_text_parent_class)->draw (widget, cr);
 	set_cursor_if_appropriate (text, -1, -1);
+	rt_search_check_visible (rtext);
 	return ret;
 }
 
 /* Rich Text parsing methods. */
 
+/* Documents are parsed into a compact run list: the text (with U+FFFC where
+   images go), the tag spans over it, plus images and anchors. The buffer is
+   then filled from it in one go, and as help texts and such get displayed
+   over and over, recent documents are kept around to skip parsing. */
+
+#define OBJECT_REPLACEMENT_CHAR "\xef\xbf\xbc"
+
+typedef enum {
+	RT_SPAN_NAMED,  // a tag of the table, by name
+	RT_SPAN_FOREGROUND, RT_SPAN_BACKGROUND, RT_SPAN_PARAGRAPH_BACKGROUND,
+	RT_SPAN_LINK, RT_SPAN_MARGIN
+} RTSpanType;
+
+typedef struct RTSpan {
+	RTSpanType type;
+	gint start, end;  // in chars; end is -1 if never closed
+	gchar *value;  // tag name, color or link
+	gint margin;
+	gboolean link_color;  // for links, whether to use the default link color
+} RTSpan;
+
+typedef struct RTImage {
+	gsize pos;  // in bytes, where the replacement char is
+	GdkPixbuf *pixbuf;
+} RTImage;
+
+typedef struct RTAnchor {
+	gint offset;
+	gchar *name;
+} RTAnchor;
+
+typedef struct RTDocument {
+	GString *text;
+	gint chars, line_start;  // length, and offset of the last line
+	GArray *spans;  // of RTSpan, in order of opening
+	GArray *images;  // of RTImage
+	GArray *anchors;  // of RTAnchor
+} RTDocument;
+
+static RTDocument *rt_document_new (void)
+{
+	RTDocument *doc = g_new (RTDocument, 1);
+	doc->text = g_string_new (NULL);
+	doc->chars = doc->line_start = 0;
+	doc->spans = g_array_new (FALSE, FALSE, sizeof (RTSpan));
+	doc->images = g_array_new (FALSE, FALSE, sizeof (RTImage));
+	doc->anchors = g_array_new (FALSE, FALSE, sizeof (RTAnchor));
+	return doc;
+}
+
+static void rt_document_free (RTDocument *doc)
+{
+	guint i;
+	for (i = 0; i < doc->spans->len; i++)
+		g_free (g_array_index (doc->spans, RTSpan, i).value);
+	for (i = 0; i < doc->images->len; i++)
+		g_object_unref (g_array_index (doc->images, RTImage, i).pixbuf);
+	for (i = 0; i < doc->anchors->len; i++)
+		g_free (g_array_index (doc->anchors, RTAnchor, i).name);
+	g_array_free (doc->spans, TRUE);
+	g_array_free (doc->images, TRUE);
+	g_array_free (doc->anchors, TRUE);
+	g_string_free (doc->text, TRUE);
+	g_free (doc);
+}
+
+static void rt_document_append (RTDocument *doc, const gchar *text, gssize len)
+{
+	if (len < 0)
+		len = strlen (text);
+	const gchar *nl;
+	for (nl = text + len - 1; nl >= text; nl--)
+		if (*nl == '\n')
+			break;
+	if (nl >= text)
+		doc->line_start = doc->chars + g_utf8_strlen (text, nl+1 - text);
+	doc->chars += g_utf8_strlen (text, len);
+	g_string_append_len (doc->text, text, len);
+}
+
+static gboolean rt_document_starts_line (RTDocument *doc)
+{ return doc->chars == doc->line_start; }
+
+static void rt_document_append_pixbuf (RTDocument *doc, GdkPixbuf *pixbuf)
+{
+	RTImage image = { doc->text->len, g_object_ref (pixbuf) };
+	g_array_append_val (doc->images, image);
+	rt_document_append (doc, OBJECT_REPLACEMENT_CHAR, -1);
+}
+
+// returns the index of the new span
+static guint rt_document_open_span (RTDocument *doc, RTSpanType type, gint start,
+                                    const gchar *value)
+{
+	RTSpan span = { type, start, -1, g_strdup (value), 0, FALSE };
+	g_array_append_val (doc->spans, span);
+	return doc->spans->len - 1;
+}
+
+/* Tags for colors, margins and links are shared by all spans of the same
+   style and nesting depth (link targets are kept apart, in the links table),
+   so the tag table doesn't fill up with single-use tags. A tag's priority
+   applies to all the text it covers, so it can't be changed once in use;
+   instead, new tags are slotted below any deeper one, so that inner spans
+   always win. When there get to be too many styles anyway, they are dropped
+   before rendering a new text. */
+#define MAX_STYLE_TAGS 128
+
+static void rt_style_tag_set_depth (YGtkRichText *rtext, GtkTextTag *tag, gint depth)
+{
+	g_object_set_data (G_OBJECT (tag), "depth", GINT_TO_POINTER (depth));
+	gint priority = -1;
+	GHashTableIter it;
+	gpointer other;
+	g_hash_table_iter_init (&it, rtext->style_tags);
+	while (g_hash_table_iter_next (&it, NULL, &other)) {
+		gint other_depth = GPOINTER_TO_INT (g_object_get_data (other, "depth"));
+		gint other_priority = gtk_text_tag_get_priority (GTK_TEXT_TAG (other));
+		if (other_depth > depth && (priority < 0 || other_priority < priority))
+			priority = other_priority;
+	}
+	if (priority >= 0)  // others keep their relative order
+		gtk_text_tag_set_priority (tag, priority);
+}
+
+static GtkTextTag *rt_span_get_tag (YGtkRichText *rtext, GtkTextBuffer *buffer,
+                                    const RTSpan *span, gint depth)
+{
+	GtkTextTagTable *table = gtk_text_buffer_get_tag_table (buffer);
+	if (span->type == RT_SPAN_NAMED)
+		return gtk_text_tag_table_lookup (table, span->value);
+
+	gboolean reverse = gtk_widget_get_default_direction() == GTK_TEXT_DIR_RTL;
+	gchar *key;
+	switch (span->type) {
+		case RT_SPAN_FOREGROUND:
+			key = g_strdup_printf ("%d:fg:%s", depth, span->value);
+			break;
+		case RT_SPAN_BACKGROUND:
+			key = g_strdup_printf ("%d:bg:%s", depth, span->value);
+			break;
+		case RT_SPAN_PARAGRAPH_BACKGROUND:
+			key = g_strdup_printf ("%d:pbg:%s", depth, span->value);
+			break;
+		case RT_SPAN_LINK:
+			key = g_strdup_printf ("%d:%s", depth, span->link_color ? "link:color" : "link");
+			break;
+		case RT_SPAN_MARGIN:
+		default:
+			key = g_strdup_printf ("%d:margin:%s%d", depth, reverse ? "r" : "", span->margin);
+			break;
+	}
+
+	GtkTextTag *tag = g_hash_table_lookup (rtext->style_tags, key);
+	if (tag) {
+		g_free (key);
+		return tag;
+	}
+
+	switch (span->type) {
+		case RT_SPAN_FOREGROUND:
+			tag = gtk_text_buffer_create_tag (buffer, NULL, "foreground", span->value, NULL);
+			break;
+		case RT_SPAN_BACKGROUND:
+			tag = gtk_text_buffer_create_tag (buffer, NULL, "background", span->value, NULL);
+			break;
+		case RT_SPAN_PARAGRAPH_BACKGROUND:
+			tag = gtk_text_buffer_create_tag (buffer, NULL,
+				"paragraph-background", span->value, NULL);
+			break;
+		case RT_SPAN_LINK:
+			tag = gtk_text_buffer_create_tag (buffer, NULL,
+				"underline", PANGO_UNDERLINE_SINGLE, NULL);
+			if (span->link_color)
+				g_object_set (tag, "foreground-gdk", &link_color, NULL);
+			break;
+		case RT_SPAN_MARGIN:
+		default: {
+			const char *margin = reverse ? "right-margin" : "left-margin";
+			tag = gtk_text_buffer_create_tag (buffer, NULL, margin, span->margin, NULL);
+			break;
+		}
+	}
+	rt_style_tag_set_depth (rtext, tag, depth);
+	g_hash_table_insert (rtext->style_tags, key, tag);
+	return tag;
+}
+
+static void rt_drop_style_tags (YGtkRichText *rtext, GtkTextBuffer *buffer)
+{
+	GtkTextTagTable *table = gtk_text_buffer_get_tag_table (buffer);
+	GHashTableIter it;
+	gpointer tag;
+	g_hash_table_iter_init (&it, rtext->style_tags);
+	while (g_hash_table_iter_next (&it, NULL, &tag))
+		gtk_text_tag_table_remove (table, GTK_TEXT_TAG (tag));
+	g_hash_table_remove_all (rtext->style_tags);
+}
+
+static void rt_document_render (RTDocument *doc, YGtkRichText *rtext)
+{
+	GtkTextBuffer *buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (rtext));
+	GtkTextIter iter, end;
+	guint i;
+
+	clear_links (rtext);
+	if (g_hash_table_size (rtext->style_tags) > MAX_STYLE_TAGS)
+		rt_drop_style_tags (rtext, buffer);
+
+	// text and images
+	if (doc->images->len == 0)
+		gtk_text_buffer_set_text (buffer, doc->text->str, doc->text->len);
+	else {
+		gtk_text_buffer_set_text (buffer, "", 0);
+		gsize pos = 0;
+		for (i = 0; i < doc->images->len; i++) {
+			RTImage *image = &g_array_index (doc->images, RTImage, i);
+			gtk_text_buffer_get_end_iter (buffer, &iter);
+			gtk_text_buffer_insert (buffer, &iter, doc->text->str + pos, image->pos - pos);
+			gtk_text_buffer_insert_pixbuf (buffer, &iter, image->pixbuf);
+			pos = image->pos + strlen (OBJECT_REPLACEMENT_CHAR);
+		}
+		gtk_text_buffer_get_end_iter (buffer, &iter);
+		gtk_text_buffer_insert (buffer, &iter, doc->text->str + pos, doc->text->len - pos);
+	}
+
+	// ends of the style spans enclosing the current one
+	GArray *open_ends = g_array_new (FALSE, FALSE, sizeof (gint));
+	for (i = 0; i < doc->spans->len; i++) {
+		RTSpan *span = &g_array_index (doc->spans, RTSpan, i);
+		if (span->end < 0)  // bad html
+			continue;
+		gint depth = 0;
+		if (span->type != RT_SPAN_NAMED) {
+			while (open_ends->len > 0 &&
+			       g_array_index (open_ends, gint, open_ends->len-1) <= span->start)
+				g_array_set_size (open_ends, open_ends->len-1);
+			depth = open_ends->len;
+			g_array_append_val (open_ends, span->end);
+		}
+		GtkTextTag *tag = rt_span_get_tag (rtext, buffer, span, depth);
+		if (tag) {
+			gtk_text_buffer_get_iter_at_offset (buffer, &iter, span->start);
+			gtk_text_buffer_get_iter_at_offset (buffer, &end, span->end);
+			gtk_text_buffer_apply_tag (buffer, tag, &iter, &end);
+		}
+		if (span->type == RT_SPAN_LINK) {
+			// spans are in order of opening, so links get sorted by start
+			RTLink link = { span->start, span->end, g_strdup (span->value) };
+			g_array_append_val (rtext->links, link);
+		}
+	}
+	g_array_free (open_ends, TRUE);
+
+	for (i = 0; i < doc->anchors->len; i++) {
+		RTAnchor *anchor = &g_array_index (doc->anchors, RTAnchor, i);
+		gtk_text_buffer_get_iter_at_offset (buffer, &iter, anchor->offset);
+		GtkTextMark *mark = gtk_text_buffer_get_mark (buffer, anchor->name);
+		if (mark)
+			gtk_text_buffer_move_mark (buffer, mark, &iter);
+		else
+			gtk_text_buffer_create_mark (buffer, anchor->name, &iter, TRUE);
+	}
+}
+
 typedef struct _HTMLList
 {
 	gboolean ordered;
@@ -250,11 +554,11 @@ static void HTMLList_init (HTMLList *list, gboolean ordered)
 }
 
 typedef struct GRTPTag {
-	GtkTextMark *mark;
-	GtkTextTag  *tag;
+	gint start;
+	gint span;  // index into the document's spans, or -1
 } GRTPTag;
 typedef struct GRTParseState {
-	GtkTextBuffer *buffer;
+	RTDocument *doc;
 	GtkTextTagTable *tags;
 	GList *htags;  // of GRTPTag
 
@@ -266,9 +570,9 @@ typedef struct GRTParseState {
 	gboolean closed_block_tag;
 } GRTParseState;
 
-static void GRTParseState_init (GRTParseState *state, GtkTextBuffer *buffer)
+static void GRTParseState_init (GRTParseState *state, GtkTextBuffer *buffer, RTDocument *doc)
 {
-	state->buffer = buffer;
+	state->doc = doc;
 	state->pre_mode = FALSE;
 	state->default_color = TRUE;
 	state->left_margin = 0;
@@ -293,7 +597,7 @@ static void GRTParseState_free (GRTParseState *state)
 	free_list (state->htags);
 }
 
-static void insert_li_enumeration (GRTParseState *state, GtkTextIter *iter, gboolean start)
+static void insert_li_enumeration (GRTParseState *state, gboolean start)
 {
 	gboolean _start = gtk_widget_get_default_direction() != GTK_TEXT_DIR_RTL;
 	if (_start != start) return;
@@ -303,12 +607,12 @@ static void insert_li_enumeration (GRTParseState *state, GtkTextIter *iter, gboo
 	    (front_list->ordered)) {
 		const gchar *form = start ? "%d. " : " .%d";
 		gchar *str = g_strdup_printf (form, front_list->enumeration++);
-		gtk_text_buffer_insert (state->buffer, iter, str, -1);
+		rt_document_append (state->doc, str, -1);
 		g_free (str);
 	}
 	else {                          // \\u25cf for bigger bullets
 		const char *str = start ? "\u2022 " : " \u2022";
-		gtk_text_buffer_insert (state->buffer, iter, str, -1);
+		rt_document_append (state->doc, str, -1);
 	}
 }
 
@@ -323,10 +627,10 @@ rt_start_element (GMarkupParseContext *context,
                   GError             **error)
 {	// Called for open tags <foo bar="baz">
 	GRTParseState *state = (GRTParseState*) user_data;
+	RTDocument *doc = state->doc;
 	GRTPTag *tag = g_malloc (sizeof (GRTPTag));
-	GtkTextIter iter;
-	gtk_text_buffer_get_end_iter (state->buffer, &iter);
-	tag->mark = gtk_text_buffer_create_mark (state->buffer, NULL, &iter, TRUE);
+	tag->start = doc->chars;  // before any paragraph break
+	tag->span = -1;
 
 	if (!g_ascii_strcasecmp (element_name, "pre"))
 		state->pre_mode = TRUE;
@@ -334,35 +638,31 @@ rt_start_element (GMarkupParseContext *context,
 	// Check if this is a block tag
 	if (isBlockTag (element_name)) {
 		// make sure this opens a new paragraph
-		if (state->html_list && gtk_text_iter_get_line_offset (&iter) < 6)
+		if (state->html_list && doc->chars - doc->line_start < 6)
 			;  // on a list, there is the "1. " in the buffer so we have to do this
-		else if (!gtk_text_iter_starts_line (&iter)) {
-			gtk_text_buffer_insert (state->buffer, &iter, "\n", -1);
-			gtk_text_buffer_get_end_iter (state->buffer, &iter);
-		}
+		else if (!rt_document_starts_line (doc))
+			rt_document_append (doc, "\n", -1);
 	}
 	state->closed_block_tag = FALSE;
 
 	char *lower = g_ascii_strdown (element_name, -1);
-	tag->tag = gtk_text_tag_table_lookup (state->tags, lower);
+	if (gtk_text_tag_table_lookup (state->tags, lower))
+		tag->span = rt_document_open_span (doc, RT_SPAN_NAMED, tag->start, lower);
 
 	// Special tags that must be inserted manually
-	if (!tag->tag) {
+	if (tag->span == -1) {
 		if (!g_ascii_strcasecmp (element_name, "font")) {
 			int i;
 			for (i = 0; attribute_names[i]; i++) {
 				const char *attrb = attribute_names[i];
 				const char *value = attribute_values[i];
 				if (!g_ascii_strcasecmp (attrb, "color")) {
-					tag->tag = gtk_text_buffer_create_tag (state->buffer, NULL,
-						"foreground", value, NULL);
+					tag->span = rt_document_open_span (doc, RT_SPAN_FOREGROUND, tag->start, value);
 					state->default_color = FALSE;
 				}
 				// not from html -- we use this internally
-				else if (!g_ascii_strcasecmp (attrb, "bgcolor")) {
-					tag->tag = gtk_text_buffer_create_tag (state->buffer, NULL,
-						"background", value, NULL);
-				}
+				else if (!g_ascii_strcasecmp (attrb, "bgcolor"))
+					tag->span = rt_document_open_span (doc, RT_SPAN_BACKGROUND, tag->start, value);
 				else
 					g_warning ("Unknown font attribute: '%s'", attrb);
 			}
@@ -370,21 +670,20 @@ rt_start_element (GMarkupParseContext *context,
 		else if (!g_ascii_strcasecmp (element_name, "a")) {
 			if (attribute_names[0] &&
 			    !g_ascii_strcasecmp (attribute_names[0], "href")) {
-				tag->tag = gtk_text_buffer_create_tag (state->buffer, NULL,
-					"underline", PANGO_UNDERLINE_SINGLE, NULL);
-				if (state->default_color)
-					g_object_set (tag->tag, "foreground-gdk", &link_color, NULL);
-				g_object_set_data (G_OBJECT (tag->tag), "link", g_strdup (attribute_values[0]));
+				tag->span = rt_document_open_span (doc, RT_SPAN_LINK, tag->start,
+					attribute_values[0]);
+				g_array_index (doc->spans, RTSpan, tag->span).link_color = state->default_color;
 			}
 			else if (attribute_names[0] &&
 				 !g_ascii_strcasecmp (attribute_names[0], "name")) {
-				gtk_text_buffer_create_mark (state->buffer, attribute_values[0], &iter, TRUE);
+				RTAnchor anchor = { doc->chars, g_strdup (attribute_values[0]) };
+				g_array_append_val (doc->anchors, anchor);
 			}
 			else
 				g_warning ("Unknown a attribute: '%s'", attribute_names[0]);
 		}
 		else if (!g_ascii_strcasecmp (element_name, "li"))
-			insert_li_enumeration (state, &iter, TRUE);
+			insert_li_enumeration (state, TRUE);
 		// Tags that affect the margin
 		else if (!g_ascii_strcasecmp (element_name, "ul") ||
 		         !g_ascii_strcasecmp (element_name, "ol")) {
@@ -404,7 +703,7 @@ rt_start_element (GMarkupParseContext *context,
 						pixbuf = gtk_icon_theme_load_icon (gtk_icon_theme_get_default(),
 							filename, 64, 0, NULL);
 					if (pixbuf) {
-						gtk_text_buffer_insert_pixbuf (state->buffer, &iter, pixbuf);
+						rt_document_append_pixbuf (doc, pixbuf);
 						g_object_unref (G_OBJECT (pixbuf));
 					}
 				}
@@ -430,20 +729,17 @@ rt_start_element (GMarkupParseContext *context,
 			// not from html (basic html only supports background color in
 			// tables), but we use this internally
 			if (!g_ascii_strcasecmp (attribute_names[0], "bgcolor"))
-				tag->tag = gtk_text_buffer_create_tag (state->buffer, NULL,
-					"paragraph-background", attribute_values[0], NULL);
+				tag->span = rt_document_open_span (doc,
+					RT_SPAN_PARAGRAPH_BACKGROUND, tag->start, attribute_values[0]);
 			else
 				g_warning ("Unknown p attribute: '%s'", attribute_names[0]);
 		}
 	}
 
-	if (!tag->tag && isIdentTag (element_name)) {
+	if (tag->span == -1 && isIdentTag (element_name)) {
 		state->left_margin += IDENT_MARGIN;
-
-		gboolean reverse = gtk_widget_get_default_direction() == GTK_TEXT_DIR_RTL;
-		const char *margin = reverse ? "right-margin" : "left-margin";
-		tag->tag = gtk_text_buffer_create_tag (state->buffer, NULL,
-			margin, state->left_margin, NULL);
+		tag->span = rt_document_open_span (doc, RT_SPAN_MARGIN, tag->start, NULL);
+		g_array_index (doc->spans, RTSpan, tag->span).margin = state->left_margin;
 	}
 
 	g_free (lower);
@@ -459,6 +755,7 @@ rt_end_element (GMarkupParseContext *context,
                 GError             **error)
 {	// Called for close tags </foo>
 	GRTParseState *state = (GRTParseState*) user_data;
+	RTDocument *doc = state->doc;
 
 	if (g_list_length (state->htags) == 0) {
 		g_warning ("Urgh - empty tag queue closing '%s'", element_name);
@@ -469,10 +766,6 @@ rt_end_element (GMarkupParseContext *context,
 	GRTPTag *tag = g_list_last (state->htags)->data;
 	state->htags = g_list_remove (state->htags, tag);
 
-	GtkTextIter start, end;
-	gtk_text_buffer_get_iter_at_mark (state->buffer, &start, tag->mark);
-	gtk_text_buffer_get_end_iter (state->buffer, &end);
-
 	gint appendLines = 0;
 
 	if (isIdentTag (element_name))
@@ -492,36 +785,29 @@ rt_end_element (GMarkupParseContext *context,
 
 	else if (!g_ascii_strcasecmp (element_name, "hr")) {
 		GdkPixbuf *pixbuf = gdk_pixbuf_new_from_xpm_data (hr_xpm);
-		gtk_text_buffer_insert_pixbuf (state->buffer, &end, pixbuf);
+		rt_document_append_pixbuf (doc, pixbuf);
 		g_object_unref (pixbuf);
-		gtk_text_buffer_get_iter_at_mark (state->buffer, &start, tag->mark);
-		gtk_text_buffer_get_end_iter (state->buffer, &end);
-		gtk_text_buffer_apply_tag_by_name (state->buffer, "center", &start, &end);
+		RTSpan center = { RT_SPAN_NAMED, tag->start, doc->chars, g_strdup ("center"), 0, FALSE };
+		g_array_append_val (doc->spans, center);
 		appendLines = 1;
 	}
 	else if (!g_ascii_strcasecmp (element_name, "li"))
-		insert_li_enumeration (state, &end, FALSE);
+		insert_li_enumeration (state, FALSE);
 
 	if (isBlockTag (element_name) || !g_ascii_strcasecmp (element_name, "br")) {
 		appendLines = 1;
-		if (isBlockTag (element_name) && gtk_text_iter_starts_line (&end))
+		if (isBlockTag (element_name) && rt_document_starts_line (doc))
 			appendLines = 0;
 		state->closed_block_tag = TRUE;
 	}
 	else
 		state->closed_block_tag = FALSE;
 
-	if (appendLines) {
-		gtk_text_buffer_insert (state->buffer, &end,
-		                        appendLines == 1 ? "\n" : "\n\n", -1);
-		gtk_text_buffer_get_iter_at_mark (state->buffer, &start, tag->mark);
-		gtk_text_buffer_get_end_iter (state->buffer, &end);
-	}
-
-	if (tag->tag)
-		gtk_text_buffer_apply_tag (state->buffer, tag->tag, &start, &end);
+	if (appendLines)
+		rt_document_append (doc, appendLines == 1 ? "\n" : "\n\n", -1);
 
-	gtk_text_buffer_delete_mark (state->buffer, tag->mark);
+	if (tag->span != -1)
+		g_array_index (doc->spans, RTSpan, tag->span).end = doc->chars;
 	g_free (tag);
 }
 
@@ -533,11 +819,8 @@ rt_text (GMarkupParseContext *context,
          GError             **error)
 {  // Called for character data, NB. text NOT nul-terminated
 	GRTParseState *state = (GRTParseState*) user_data;
-	GtkTextIter start, end;
-	gtk_text_buffer_get_end_iter (state->buffer, &start);
 	if (state->pre_mode)
-		gtk_text_buffer_insert_with_tags (state->buffer, &start,
-		                                  text, text_len, NULL, NULL);
+		rt_document_append (state->doc, text, text_len);
 	else {
 		gboolean rtl = gtk_widget_get_default_direction() == GTK_TEXT_DIR_RTL;
 
@@ -549,14 +832,13 @@ rt_text (GMarkupParseContext *context,
 		}
 
 		// hack: for right-to-left languages, change "Device:" to ":Device" (bug 581800)
-		if (rtl && text[text_len-1] == ':') {
-			gtk_text_buffer_insert (state->buffer, &start, ":", 1);
+		if (rtl && i < text_len && text[text_len-1] == ':') {
+			rt_document_append (state->doc, ":", 1);
 			text_len--;
 		}
 
-		gtk_text_buffer_insert (state->buffer, &start, text+i, text_len-i);
+		rt_document_append (state->doc, text+i, text_len-i);
 	}
-	gtk_text_buffer_get_end_iter (state->buffer, &end);
 }
 
 static void
@@ -584,6 +866,85 @@ static GMarkupParser rt_parser = {
 	rt_error
 };
 
+static RTDocument *rt_document_parse (GtkTextBuffer *buffer, const gchar *text)
+{
+	RTDocument *doc = rt_document_new();
+	GRTParseState state;
+	GRTParseState_init (&state, buffer, doc);
+
+	GMarkupParseContext *ctx;
+	ctx = g_markup_parse_context_new (&rt_parser, (GMarkupParseFlags)0, &state, NULL);
+
+	char *xml = ygutils_convert_to_xhtml (text);
+	GError *error = NULL;
+	if (!g_markup_parse_context_parse (ctx, xml, -1, &error)) {
+		g_warning ("Markup parse error '%s'", error ? error->message : "Unknown");
+		g_clear_error (&error);
+	}
+	g_free (xml);
+
+	g_markup_parse_context_free (ctx);
+	GRTParseState_free (&state);
+
+	// remove last empty line, if any
+	if (doc->text->len && doc->text->str[doc->text->len-1] == '\n') {
+		g_string_truncate (doc->text, doc->text->len-1);
+		doc->chars--;
+		guint i;
+		for (i = 0; i < doc->spans->len; i++) {
+			RTSpan *span = &g_array_index (doc->spans, RTSpan, i);
+			span->start = MIN (span->start, doc->chars);
+			span->end = MIN (span->end, doc->chars);
+		}
+		for (i = 0; i < doc->anchors->len; i++) {
+			RTAnchor *anchor = &g_array_index (doc->anchors, RTAnchor, i);
+			anchor->offset = MIN (anchor->offset, doc->chars);
+		}
+	}
+	return doc;
+}
+
+// cache of recently parsed documents, by content hash
+#define DOCUMENT_CACHE_SIZE 16
+#define DOCUMENT_CACHE_MAX_TEXT (512*1024)
+
+static GHashTable *document_cache = NULL;
+static GQueue document_cache_lru = G_QUEUE_INIT;  // of keys; head = most recent
+
+static gchar *rt_document_cache_key (const gchar *text)
+{
+	// parsing depends on the text direction
+	gboolean rtl = gtk_widget_get_default_direction() == GTK_TEXT_DIR_RTL;
+	gchar *hash = g_compute_checksum_for_string (G_CHECKSUM_SHA1, text, -1);
+	gchar *key = g_strconcat (rtl ? "rtl:" : "ltr:", hash, NULL);
+	g_free (hash);
+	return key;
+}
+
+static RTDocument *rt_document_cache_lookup (const gchar *key)
+{
+	if (!document_cache)
+		return NULL;
+	RTDocument *doc = g_hash_table_lookup (document_cache, key);
+	if (doc) {
+		GList *link = g_queue_find_custom (&document_cache_lru, key, (GCompareFunc) strcmp);
+		g_queue_unlink (&document_cache_lru, link);
+		g_queue_push_head_link (&document_cache_lru, link);
+	}
+	return doc;
+}
+
+static void rt_document_cache_insert (gchar *key, RTDocument *doc)
+{
+	if (!document_cache)
+		document_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+			g_free, (GDestroyNotify) rt_document_free);
+	g_hash_table_insert (document_cache, key, doc);
+	g_queue_push_head (&document_cache_lru, key);
+	if (g_queue_get_length (&document_cache_lru) > DOCUMENT_CACHE_SIZE)
+		g_hash_table_remove (document_cache, g_queue_pop_tail (&document_cache_lru));
+}
+
 GtkWidget *ygtk_rich_text_new (void)
 { return g_object_new (YGTK_TYPE_RICH_TEXT, NULL); }
 
@@ -610,37 +971,32 @@ static void ygtk_rich_text_set_rtl (YGtkRichText *rtext)
 void ygtk_rich_text_set_plain_text (YGtkRichText* rtext, const gchar* text)
 {
 	GtkTextBuffer *buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (rtext));
+	clear_links (rtext);
+	rt_search_reset (rtext);
 	gtk_text_buffer_set_text (buffer, text, -1);
 }
 
 void ygtk_rich_text_set_text (YGtkRichText* rtext, const gchar* text)
 {
 	GtkTextBuffer *buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (rtext));
-	gtk_text_buffer_set_text (buffer, "", 0);  // remove any existing text
-
-	GRTParseState state;
-	GRTParseState_init (&state, buffer);
-
-	GMarkupParseContext *ctx;
-	ctx = g_markup_parse_context_new (&rt_parser, (GMarkupParseFlags)0, &state, NULL);
+	rt_search_reset (rtext);
 
-	char *xml = ygutils_convert_to_xhtml (text);
-	GError *error = NULL;
-	if (!g_markup_parse_context_parse (ctx, xml, -1, &error)) {
-		g_warning ("Markup parse error '%s'", error ? error->message : "Unknown");
+	gchar *key = rt_document_cache_key (text);
+	RTDocument *doc = rt_document_cache_lookup (key);
+	if (doc) {
+		rt_document_render (doc, rtext);
+		g_free (key);
+	}
+	else {
+		doc = rt_document_parse (buffer, text);
+		rt_document_render (doc, rtext);
+		if (doc->text->len <= DOCUMENT_CACHE_MAX_TEXT)
+			rt_document_cache_insert (key, doc);
+		else {
+			rt_document_free (doc);
+			g_free (key);
+		}
 	}
-	g_free (xml);
-
-	g_markup_parse_context_free (ctx);
-	GRTParseState_free (&state);
-
-	// remove last empty line, if any
-	GtkTextIter end_it, before_end_it;
-	gtk_text_buffer_get_end_iter (buffer, &end_it);
-	before_end_it = end_it;
-	if (gtk_text_iter_backward_char (&before_end_it) &&
-	    gtk_text_iter_get_char (&before_end_it) == '\n')
-		gtk_text_buffer_delete (buffer, &before_end_it, &end_it);
 
 	// GtkTextView does LTR and RTL depending on the paragraph; we want
 	// to change that behavior so it's RTL to the all thing for Arabic
@@ -648,64 +1004,214 @@ void ygtk_rich_text_set_text (YGtkRichText* rtext, const gchar* text)
 		ygtk_rich_text_set_rtl (rtext);
 }
 
-/* gtk_text_iter_forward_search() is case-sensitive so we roll our own.
-   The idea is to keep use get_text and strstr there, but to be more
-   efficient we check per line. */
-static gboolean ygtk_rich_text_forward_search (const GtkTextIter *begin,
-	const GtkTextIter *end, const gchar *_key, GtkTextIter *match_start,
-	GtkTextIter *match_end)
-{
-	if (*_key == 0)
-		return FALSE;
+/* Search support. gtk_text_iter_forward_search() is case-sensitive, and
+   walking iters char by char is slow on long texts, so we keep a lower-cased
+   UCS-4 copy of the buffer (one gunichar per buffer offset) and run
+   Boyer-Moore-Horspool on it. Only matches around the visible area get
+   highlighted; the rest are marked as the user scrolls. */
+
+#define SEARCH_MARK_MARGIN 4096  // chars to highlight around the visible area
 
-	/* gtk_text_iter_get_char() returns a gunichar (ucs4 coding), so we
-	   convert the given string (which is utf-8, like anyhting in gtk+) */
-	gunichar *key = g_utf8_to_ucs4 (_key, -1, NULL, NULL, NULL);
+typedef struct _YGtkRichTextSearch {
+	gunichar *key;
+	gint len;
+	gint skip[256];  // Horspool shifts, by the low byte of the char
+	gint marked_start, marked_end;  // match starts already highlighted
+} YGtkRichTextSearch;
+
+static YGtkRichTextSearch *rt_search_new (const gchar *text)
+{
+	glong len;
+	gunichar *key = g_utf8_to_ucs4 (text, -1, NULL, &len, NULL);
 	if (!key)  // conversion error -- should not happen
-		return FALSE;
+		return NULL;
+	if (len == 0) {
+		g_free (key);
+		return NULL;
+	}
 
-	// convert key to lower case, to avoid work later
-	gunichar *k;
-	for (k = key; *k; k++)
-		*k = g_unichar_tolower (*k);
-
-	GtkTextIter iter = *begin, iiter;
-	while (!gtk_text_iter_is_end (&iter) && gtk_text_iter_compare (&iter, end) <= 0) {
-		iiter = iter;
-		for (k = key; *k == g_unichar_tolower (gtk_text_iter_get_char (&iiter)) && (*k);
-		     k++, gtk_text_iter_forward_char (&iiter))
-			;
-		if (!*k) {
-			*match_start = iter;
-			*match_end = iiter;
-			return TRUE;
-		}
-		gtk_text_iter_forward_char (&iter);
+	YGtkRichTextSearch *search = g_new (YGtkRichTextSearch, 1);
+	search->key = key;
+	search->len = len;
+	search->marked_start = search->marked_end = 0;
+
+	gint i;
+	for (i = 0; i < len; i++)
+		key[i] = g_unichar_tolower (key[i]);
+	for (i = 0; i < 256; i++)
+		search->skip[i] = len;
+	// chars sharing a low byte share a slot; the smallest shift is still safe
+	for (i = 0; i < len-1; i++)
+		search->skip[key[i] & 0xff] = len-1 - i;
+	return search;
+}
+
+static void rt_search_free (YGtkRichTextSearch *search)
+{
+	if (search) {
+		g_free (search->key);
+		g_free (search);
+	}
+}
+
+static const gunichar *rt_folded_text (YGtkRichText *rtext)
+{
+	if (!rtext->folded_text) {
+		GtkTextBuffer *buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (rtext));
+		GtkTextIter start, end;
+		gtk_text_buffer_get_bounds (buffer, &start, &end);
+		// the slice has U+FFFC for images, so chars match buffer offsets
+		gchar *text = gtk_text_buffer_get_slice (buffer, &start, &end, TRUE);
+		glong len;
+		rtext->folded_text = g_utf8_to_ucs4_fast (text, -1, &len);
+		rtext->folded_len = len;
+		g_free (text);
+
+		gunichar *c;
+		for (c = rtext->folded_text; *c; c++)
+			*c = g_unichar_tolower (*c);
+	}
+	return rtext->folded_text;
+}
+
+// Offset of the first match starting in [from, to), or -1.
+static gint rt_search_find (YGtkRichText *rtext, YGtkRichTextSearch *search,
+                            gint from, gint to)
+{
+	const gunichar *text = rt_folded_text (rtext);
+	const gunichar *key = search->key;
+	gint len = search->len;
+	gint last = MIN (to - 1, rtext->folded_len - len);
+	gint pos;
+	for (pos = MAX (from, 0); pos <= last; ) {
+		gunichar c = text[pos + len-1];
+		if (c == key[len-1] &&
+		    memcmp (text + pos, key, (len-1) * sizeof (gunichar)) == 0)
+			return pos;
+		pos += search->skip[c & 0xff];
+	}
+	return -1;
+}
+
+static void rt_search_mark_range (YGtkRichText *rtext, gint from, gint to)
+{
+	GtkTextBuffer *buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (rtext));
+	YGtkRichTextSearch *search = rtext->search;
+	GtkTextIter match_start, match_end;
+	gint pos = from;
+	while ((pos = rt_search_find (rtext, search, pos, to)) >= 0) {
+		gtk_text_buffer_get_iter_at_offset (buffer, &match_start, pos);
+		gtk_text_buffer_get_iter_at_offset (buffer, &match_end, pos + search->len);
+		gtk_text_buffer_apply_tag_by_name (buffer, "keyword", &match_start, &match_end);
+		pos += search->len;
 	}
+}
+
+// Range of chars that should be highlighted for the current scroll position.
+static void rt_search_wanted_range (YGtkRichText *rtext, gint *start, gint *end)
+{
+	GtkTextView *view = GTK_TEXT_VIEW (rtext);
+	GdkRectangle rect;
+	GtkTextIter iter;
+	gtk_text_view_get_visible_rect (view, &rect);
+	gtk_text_view_get_iter_at_location (view, &iter, rect.x, rect.y);
+	*start = MAX (gtk_text_iter_get_offset (&iter) - SEARCH_MARK_MARGIN, 0);
+	gtk_text_view_get_iter_at_location (view, &iter,
+		rect.x + rect.width, rect.y + rect.height);
+	*end = MIN (gtk_text_iter_get_offset (&iter) + SEARCH_MARK_MARGIN,
+		rtext->folded_len);
+}
+
+static void rt_search_update_marks (YGtkRichText *rtext)
+{
+	YGtkRichTextSearch *search = rtext->search;
+	gint start, end;
+	rt_folded_text (rtext);
+	rt_search_wanted_range (rtext, &start, &end);
+	if (start >= search->marked_start && end <= search->marked_end)
+		return;
+
+	if (end < search->marked_start || start > search->marked_end) {
+		// scrolled far away: forget what was marked rather than fill the gap
+		GtkTextBuffer *buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (rtext));
+		GtkTextIter iter, iend;
+		gtk_text_buffer_get_iter_at_offset (buffer, &iter, search->marked_start);
+		gtk_text_buffer_get_iter_at_offset (buffer, &iend,
+			search->marked_end + search->len);
+		gtk_text_buffer_remove_tag_by_name (buffer, "keyword", &iter, &iend);
+		search->marked_start = search->marked_end = start;
+	}
+	if (start < search->marked_start) {
+		rt_search_mark_range (rtext, start, search->marked_start);
+		search->marked_start = start;
+	}
+	if (end > search->marked_end) {
+		rt_search_mark_range (rtext, search->marked_end, end);
+		search->marked_end = end;
+	}
+}
+
+static gboolean rt_search_idle_cb (gpointer data)
+{
+	YGtkRichText *rtext = YGTK_RICH_TEXT (data);
+	rtext->search_idle_id = 0;
+	if (rtext->search)
+		rt_search_update_marks (rtext);
 	return FALSE;
 }
 
+// Called on draw: tags can't be touched while drawing, so defer to idle.
+static void rt_search_check_visible (YGtkRichText *rtext)
+{
+	YGtkRichTextSearch *search = rtext->search;
+	if (!search || rtext->search_idle_id)
+		return;
+	gint start, end;
+	rt_folded_text (rtext);
+	rt_search_wanted_range (rtext, &start, &end);
+	if (start < search->marked_start || end > search->marked_end)
+		rtext->search_idle_id = g_idle_add (rt_search_idle_cb, rtext);
+}
+
+// Forgets the search state; to be called when the text changes.
+static void rt_search_reset (YGtkRichText *rtext)
+{
+	g_free (rtext->folded_text);
+	rtext->folded_text = NULL;
+	rtext->folded_len = 0;
+	rt_search_free (rtext->search);
+	rtext->search = NULL;
+	if (rtext->search_idle_id) {
+		g_source_remove (rtext->search_idle_id);
+		rtext->search_idle_id = 0;
+	}
+}
+
 gboolean ygtk_rich_text_mark_text (YGtkRichText *rtext, const gchar *text)
 {
 	GtkTextBuffer *buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (rtext));
-	GtkTextIter iter, end, match_start, match_end;
+	GtkTextIter iter, end;
 
 	gtk_text_buffer_get_bounds (buffer, &iter, &end);
 	gtk_text_buffer_remove_tag_by_name (buffer, "keyword", &iter, &end);
 
 	gtk_text_buffer_select_range (buffer, &iter, &iter);  // unselect text
+	rt_search_free (rtext->search);
+	rtext->search = NULL;
 	if (!text || *text == '\0')
 		return TRUE;
 
-	gboolean found = FALSE;
-	while (ygtk_rich_text_forward_search (&iter, &end, text,
-	                                     &match_start, &match_end)) {
-		found = TRUE;
-		gtk_text_buffer_apply_tag_by_name (buffer, "keyword", &match_start, &match_end);
-		iter = match_end;
-		gtk_text_iter_forward_char (&iter);
+	rtext->search = rt_search_new (text);
+	if (!rtext->search)
+		return FALSE;
+	rt_folded_text (rtext);
+	if (rt_search_find (rtext, rtext->search, 0, rtext->folded_len) < 0) {
+		rt_search_free (rtext->search);
+		rtext->search = NULL;
+		return FALSE;
 	}
-	return found;
+	rt_search_update_marks (rtext);
+	return TRUE;
 }
 
 gboolean ygtk_rich_text_forward_mark (YGtkRichText *rtext, const gchar *text)
@@ -714,18 +1220,21 @@ gboolean ygtk_rich_text_forward_mark (YGtkRichText *rtext, const gchar *text)
 	GtkTextBuffer *buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (rtext));
 	gtk_text_buffer_get_iter_at_mark (buffer, &start_iter,
 	                                  gtk_text_buffer_get_selection_bound (buffer));
-	gtk_text_buffer_get_end_iter (buffer, &end_iter);
 
-	gboolean found;
-	found = ygtk_rich_text_forward_search (&start_iter, &end_iter, text,
-	                                      &start_iter, &end_iter);
-	if (!found) {
-		gtk_text_buffer_get_start_iter (buffer, &start_iter);
-		found = ygtk_rich_text_forward_search (&start_iter, &end_iter, text,
-		                                      &start_iter, &end_iter);
-	}
-
-	if (found) {
+	YGtkRichTextSearch *search = rt_search_new (text);
+	if (!search)
+		return FALSE;
+	rt_folded_text (rtext);
+	gint pos = rt_search_find (rtext, search, gtk_text_iter_get_offset (&start_iter),
+	                           rtext->folded_len);
+	if (pos < 0)
+		pos = rt_search_find (rtext, search, 0, rtext->folded_len);
+	gint len = search->len;
+	rt_search_free (search);
+
+	if (pos >= 0) {
+		gtk_text_buffer_get_iter_at_offset (buffer, &start_iter, pos);
+		gtk_text_buffer_get_iter_at_offset (buffer, &end_iter, pos + len);
 		gtk_text_view_scroll_to_iter (GTK_TEXT_VIEW (rtext), &start_iter, 0.10,
 		                              FALSE, 0, 0);
 		gtk_text_buffer_select_range (buffer, &start_iter, &end_iter);
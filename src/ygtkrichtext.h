@@ -31,6 +31,13 @@ typedef struct _YGtkRichText
 	// members:
 	GdkCursor *hand_cursor;
 	GdkPixbuf *background_pixbuf;
+	GHashTable *style_tags;  // style key -> shared GtkTextTag
+	GArray *links;  // link targets of the current text, by offset
+	// search support
+	gunichar *folded_text;  // lower-cased copy of the buffer, built on demand
+	gint folded_len;
+	struct _YGtkRichTextSearch *search;  // key being highlighted, if any
+	guint search_idle_id;
 } YGtkRichText;
 
 typedef struct _YGtkRichTextClass
@@ -15,27 +15,20 @@ static guint zone_clicked_signal;
 
 // General utilities
 
-static char *substring (const char *str, int start, int end)
-{
-	if (end == -1)
-		return g_strdup (str+start);
-	return g_strndup (str+start, end-start);
-}
-
-static gdouble convert_pos (const char *pos, int digits)
+// pos must be writable; it is restored before returning
+static gdouble convert_pos (gchar *pos, int digits)
 {
 	if (strlen (pos) < 4 || digits > 9)
 		return 0.0;
 
-	gchar *whole = substring (pos, 0, digits+1);
-	gchar *fraction = substring (pos, digits+1, -1);
-
-	gdouble t1 = g_strtod (whole, NULL);
-    gdouble t2 = g_strtod (fraction, NULL);
-
+	gchar *fraction = pos + digits+1;
+	gdouble t2 = g_strtod (fraction, NULL);
 	int fraction_len = strlen (fraction);
-	g_free (whole);
-	g_free (fraction);
+
+	gchar c = *fraction;
+	*fraction = '\0';
+	gdouble t1 = g_strtod (pos, NULL);
+	*fraction = c;
 
 	if (t1 >= 0.0)
 		return t1 + t2/pow (10.0, fraction_len);
@@ -96,26 +89,153 @@ static void coordinates_to_map (YGtkTimeZonePicker *picker, gdouble latitude, gd
 	*map_y = picker->map_height/2 - (picker->map_height/2 * latitude/90);
 }
 
+/* Hit testing only considers locations within sqrt(HIT_DIST2) map pixels
+   of the pointer, so bucketing them into cells at least that wide lets us
+   look at just the 3x3 cells around it. */
+#define HIT_DIST2 4000
+#define GRID_CELL 64
+
+static void grid_cell_at (YGtkTimeZonePicker *picker, gint map_x, gint map_y,
+                          gint *col, gint *row)
+{
+	*col = CLAMP (map_x / GRID_CELL, 0, picker->grid_cols-1);
+	*row = CLAMP (map_y / GRID_CELL, 0, picker->grid_rows-1);
+}
+
+static void free_grid (YGtkTimeZonePicker *picker)
+{
+	if (picker->grid) {
+		int i;
+		for (i = 0; i < picker->grid_cols * picker->grid_rows; i++)
+			g_slist_free (picker->grid[i]);
+		g_free (picker->grid);
+		picker->grid = NULL;
+	}
+	picker->grid_cols = picker->grid_rows = 0;
+}
+
+static void build_grid (YGtkTimeZonePicker *picker)
+{
+	free_grid (picker);
+	picker->grid_cols = picker->map_width / GRID_CELL + 1;
+	picker->grid_rows = picker->map_height / GRID_CELL + 1;
+	picker->grid = g_new0 (GSList *, picker->grid_cols * picker->grid_rows);
+
+	// walk backwards so each cell keeps the locations' order
+	int i;
+	for (i = (int) picker->locations->len-1; i >= 0; i--) {
+		YGtkTimeZoneLocation *loc = &g_array_index (picker->locations,
+			YGtkTimeZoneLocation, i);
+		int col, row;
+		grid_cell_at (picker, loc->x, loc->y, &col, &row);
+		GSList **cell = &picker->grid [row * picker->grid_cols + col];
+		*cell = g_slist_prepend (*cell, loc);
+	}
+}
+
 static YGtkTimeZoneLocation *find_location_closer_to (YGtkTimeZonePicker *picker,
 	gint win_x, gint win_y)
 {
+	if (!picker->grid)
+		return NULL;
 	gint x, y;
 	window_to_map (picker, win_x, win_y, &x, &y);
 
-	double min_dist = 4000;
+	int col, row;
+	grid_cell_at (picker, x, y, &col, &row);
+
+	gint min_dist = HIT_DIST2;
 	YGtkTimeZoneLocation *best = 0;
-	GList *i;
-	for (i = picker->locations; i; i = i->next) {
-		YGtkTimeZoneLocation *loc = i->data;
-		gdouble dist = pow (loc->x - x, 2) + pow (loc->y - y, 2);
-		if (dist < min_dist) {
-			min_dist = dist;
-			best = loc;
+	int c, r;
+	for (r = MAX (row-1, 0); r <= MIN (row+1, picker->grid_rows-1); r++)
+		for (c = MAX (col-1, 0); c <= MIN (col+1, picker->grid_cols-1); c++) {
+			GSList *i;
+			for (i = picker->grid [r * picker->grid_cols + c]; i; i = i->next) {
+				YGtkTimeZoneLocation *loc = i->data;
+				gint dx = loc->x - x, dy = loc->y - y;
+				gint dist = dx*dx + dy*dy;
+				if (dist < min_dist) {
+					min_dist = dist;
+					best = loc;
+				}
+			}
 		}
-	}
 	return best;
 }
 
+static void invalidate_map_cache (YGtkTimeZonePicker *picker)
+{
+	if (picker->map_cache) {
+		cairo_surface_destroy (picker->map_cache);
+		picker->map_cache = NULL;
+	}
+}
+
+static void draw_location (cairo_t *cr, int x, int y, int radius,
+                           double r, double g, double b)
+{
+	cairo_set_source_rgb (cr, r, g, b);
+	cairo_arc (cr, x-1, y-1, radius, 0, M_PI*2);
+	if (radius > 1) {
+		cairo_fill_preserve (cr);
+		cairo_set_source_rgb (cr, 90/255.0, 90/255.0, 90/255.0);
+		cairo_set_line_width (cr, 1.0);
+		cairo_stroke (cr);
+	}
+	else
+		cairo_fill (cr);
+}
+
+// the label is drawn at (x, y) with a one pixel shadow to its bottom-right
+static PangoLayout *create_label_layout (YGtkTimeZonePicker *picker,
+	YGtkTimeZoneLocation *loc, gint *x, gint *y, gint *width, gint *height)
+{
+	const char *text = loc->tooltip;
+	if (!text) {
+		text = loc->country;
+		if (!text)
+			text = loc->zone;
+	}
+
+	GtkWidget *widget = GTK_WIDGET (picker);
+	PangoLayout *layout = gtk_widget_create_pango_layout (widget, text);
+	pango_layout_get_pixel_size (layout, width, height);
+
+	map_to_window (picker, loc->x, loc->y, x, y);
+	*x += 10; *y += 3;
+	int alloc_width = gtk_widget_get_allocated_width (widget);
+	*x = MAX (MIN (*x, alloc_width - *width - 6), *x-11-*width);
+	return layout;
+}
+
+static void queue_draw_location (YGtkTimeZonePicker *picker, YGtkTimeZoneLocation *loc)
+{
+	if (!loc)
+		return;
+	GtkWidget *widget = GTK_WIDGET (picker);
+	int x, y, w, h;
+	map_to_window (picker, loc->x, loc->y, &x, &y);
+	gtk_widget_queue_draw_area (widget, x-6, y-6, 11, 11);
+
+	PangoLayout *layout = create_label_layout (picker, loc, &x, &y, &w, &h);
+	gtk_widget_queue_draw_area (widget, x, y, w+1, h+1);
+	g_object_unref (G_OBJECT (layout));
+}
+
+static void ygtk_time_zone_picker_set_hover (YGtkTimeZonePicker *picker,
+                                             YGtkTimeZoneLocation *loc)
+{
+	if (picker->hover_loc == loc)
+		return;
+	// only the dots and labels involved need repainting: the selected
+	// location's label is shown whenever nothing is hovered
+	queue_draw_location (picker, picker->hover_loc);
+	queue_draw_location (picker, loc);
+	if (!picker->hover_loc || !loc)
+		queue_draw_location (picker, picker->selected_loc);
+	picker->hover_loc = loc;
+}
+
 // Internal methods
 
 static void ygtk_time_zone_picker_sync_cursor (YGtkTimeZonePicker *picker)
@@ -159,13 +279,39 @@ static gint compare_locations (gconstpointer pa, gconstpointer pb)
 {
 	const YGtkTimeZoneLocation *a = pa;
 	const YGtkTimeZoneLocation *b = pb;
-	return a->latitude - b->latitude;
+	if (a->latitude < b->latitude)
+		return -1;
+	return a->latitude > b->latitude ? 1 : 0;
+}
+
+static void free_locations (YGtkTimeZonePicker *picker)
+{
+	free_grid (picker);
+	picker->selected_loc = picker->hover_loc = NULL;
+	if (picker->zone_index) {
+		g_hash_table_destroy (picker->zone_index);
+		picker->zone_index = NULL;
+	}
+	if (picker->locations) {
+		guint i;
+		for (i = 0; i < picker->locations->len; i++) {
+			YGtkTimeZoneLocation *loc = &g_array_index (picker->locations,
+				YGtkTimeZoneLocation, i);
+			g_free (loc->country);
+			g_free (loc->zone);
+			g_free (loc->comment);
+			g_free (loc->tooltip);
+		}
+		g_array_free (picker->locations, TRUE);
+		picker->locations = NULL;
+	}
 }
 
 void ygtk_time_zone_picker_set_map (YGtkTimeZonePicker *picker, const char *filename,
 	TimeZoneToName converter_cb, gpointer converter_data)
 {
 	GError *error = 0;
+	invalidate_map_cache (picker);
 	picker->map_pixbuf = gdk_pixbuf_new_from_file (filename, &error);
 	if (picker->map_pixbuf) {
 		picker->map_width = gdk_pixbuf_get_width (picker->map_pixbuf);
@@ -175,45 +321,69 @@ void ygtk_time_zone_picker_set_map (YGtkTimeZonePicker *picker, const char *file
 		g_warning ("Couldn't load map: %s\n%s\n", filename, error ? error->message : "(unknown)");
 		picker->map_width = 300; picker->map_height = 50;
 	}
-
-	char buf [4096];
-	FILE *tzfile = fopen ("/usr/share/zoneinfo/zone.tab", "r");
-	while (fgets (buf, sizeof (buf), tzfile)) {
-		if (*buf == '#') continue;
-
-		gchar *trim = g_strstrip (buf);
-		gchar **arr = g_strsplit (trim, "\t", -1);
-
-		int arr_length;
-		for (arr_length = 0; arr [arr_length]; arr_length++) ;
-
-		YGtkTimeZoneLocation *loc = g_new0 (YGtkTimeZoneLocation, 1);
-		loc->country = g_strdup (arr[0]);
-		loc->zone = g_strdup (arr[2]);
-		if (arr_length > 3)
-			loc->comment = g_strdup (arr[3]);
-		const gchar *tooltip = converter_cb (loc->zone, converter_data);
+	if (error)
+		g_clear_error (&error);
+
+	free_locations (picker);
+	picker->locations = g_array_sized_new (FALSE, TRUE, sizeof (YGtkTimeZoneLocation), 512);
+	picker->zone_index = g_hash_table_new (g_str_hash, g_str_equal);
+
+	// zone.tab lines are: country <tab> coordinates <tab> zone [<tab> comment]
+	gchar *contents;
+	if (!g_file_get_contents ("/usr/share/zoneinfo/zone.tab", &contents, NULL, &error)) {
+		g_warning ("Couldn't read time zones: %s\n", error->message);
+		g_error_free (error);
+		return;
+	}
+	gchar *line, *next;
+	for (line = contents; *line; line = next) {
+		next = strchr (line, '\n');
+		if (next)
+			*(next++) = '\0';
+		else
+			next = line + strlen (line);
+		if (*line == '#') continue;
+
+		gchar *fields [4] = { 0 }, *f = g_strstrip (line);
+		int fields_nb = 0;
+		while (f && fields_nb < 4) {
+			fields [fields_nb++] = f;
+			if ((f = strchr (f, '\t')))
+				*(f++) = '\0';
+		}
+		if (fields_nb < 3) continue;
+
+		YGtkTimeZoneLocation loc = { 0 };
+		loc.country = g_strdup (fields[0]);
+		loc.zone = g_strdup (fields[2]);
+		if (fields[3])
+			loc.comment = g_strdup (fields[3]);
+		const gchar *tooltip = converter_cb (loc.zone, converter_data);
 		if (tooltip)
-			loc->tooltip = g_strdup (tooltip);
+			loc.tooltip = g_strdup (tooltip);
 
+		gchar *pos = fields[1];
 		int split_i = 1;
-		while (split_i < strlen (arr[1]) && arr[1][split_i] != '-' && arr[1][split_i] != '+' )
-            split_i++;
-		char *latitude = substring (arr[1], 0, split_i);
-		char *longitude = substring (arr[1], split_i, -1);
-
-		loc->latitude = convert_pos (latitude, 2);
-        loc->longitude = convert_pos (longitude, 3);
-        g_free (latitude);
-        g_free (longitude);
-
-		coordinates_to_map (picker, loc->latitude, loc->longitude, &loc->x, &loc->y);
-
-		picker->locations = g_list_append (picker->locations, loc);
-		g_strfreev (arr);
+		while (pos[split_i] && pos[split_i] != '-' && pos[split_i] != '+')
+			split_i++;
+		loc.longitude = convert_pos (pos + split_i, 3);
+		pos[split_i] = '\0';
+		loc.latitude = convert_pos (pos, 2);
+
+		coordinates_to_map (picker, loc.latitude, loc.longitude, &loc.x, &loc.y);
+		g_array_append_val (picker->locations, loc);
+	}
+	g_free (contents);
+
+	// the array is final now: index it and hand out pointers to its elements
+	g_array_sort (picker->locations, compare_locations);
+	guint i;
+	for (i = 0; i < picker->locations->len; i++) {
+		YGtkTimeZoneLocation *loc = &g_array_index (picker->locations,
+			YGtkTimeZoneLocation, i);
+		g_hash_table_insert (picker->zone_index, loc->zone, GUINT_TO_POINTER (i));
 	}
-	fclose (tzfile);
-	picker->locations = g_list_sort (picker->locations, compare_locations);
+	build_grid (picker);
 }
 
 const gchar *ygtk_time_zone_picker_get_current_zone (YGtkTimeZonePicker *picker)
@@ -228,14 +398,13 @@ void ygtk_time_zone_picker_set_current_zone (YGtkTimeZonePicker *picker,
 {
 	if (picker->selected_loc && !strcmp (picker->selected_loc->zone, zone))
 		return;
-	GList *i;
-	for (i = picker->locations; i; i = i->next) {
-		YGtkTimeZoneLocation *loc = i->data;
-		if (!strcmp (loc->zone, zone)) {
-			picker->selected_loc = loc;
-			ygtk_time_zone_picker_closeup (picker, zoom, loc->x, loc->y, TRUE);
-			break;
-		}
+	gpointer index;
+	if (picker->zone_index &&
+	    g_hash_table_lookup_extended (picker->zone_index, zone, NULL, &index)) {
+		YGtkTimeZoneLocation *loc = &g_array_index (picker->locations,
+			YGtkTimeZoneLocation, GPOINTER_TO_UINT (index));
+		picker->selected_loc = loc;
+		ygtk_time_zone_picker_closeup (picker, zoom, loc->x, loc->y, TRUE);
 	}
 	gtk_widget_queue_draw (GTK_WIDGET (picker));
 }
@@ -252,23 +421,12 @@ static void ygtk_time_zone_picker_init (YGtkTimeZonePicker *picker)
 static void ygtk_time_zone_picker_destroy (GtkWidget *widget)
 {
 	YGtkTimeZonePicker *picker = YGTK_TIME_ZONE_PICKER (widget);
+	invalidate_map_cache (picker);
 	if (picker->map_pixbuf) {
 		g_object_unref (G_OBJECT (picker->map_pixbuf));
 		picker->map_pixbuf = NULL;
 	}
-	if (picker->locations) {
-		GList *i;
-		for (i = picker->locations; i; i = i->next) {
-			YGtkTimeZoneLocation *loc = i->data;
-			g_free (loc->country);
-			g_free (loc->zone);
-			g_free (loc->comment);
-			g_free (loc->tooltip);
-			g_free (loc);
-		}
-		g_list_free (picker->locations);
-		picker->locations = NULL;
-	}
+	free_locations (picker);
 	GTK_WIDGET_CLASS (ygtk_time_zone_picker_parent_class)->destroy(widget);
 }
 
@@ -307,6 +465,7 @@ static void ygtk_time_zone_picker_realize (GtkWidget *widget)
 static void ygtk_time_zone_picker_unrealize (GtkWidget *widget)
 {
 	YGtkTimeZonePicker *picker = YGTK_TIME_ZONE_PICKER (widget);
+	invalidate_map_cache (picker);
 	if (picker->map_window) {
 		gdk_window_set_user_data (picker->map_window, NULL);
 		gdk_window_destroy (picker->map_window);
@@ -339,10 +498,7 @@ static gboolean ygtk_time_zone_picker_motion_notify_event (GtkWidget *widget,
 		if (picker->scale == 1) {
 			YGtkTimeZoneLocation *loc;
 			loc = find_location_closer_to (picker, event->x, event->y);
-			if (picker->hover_loc != loc) {
-				picker->hover_loc = loc;
-				gtk_widget_queue_draw (widget);
-			}
+			ygtk_time_zone_picker_set_hover (picker, loc);
 		}
 		if (picker->last_mouse_x) {
 			ygtk_time_zone_picker_move (picker, picker->last_mouse_x - event->x,
@@ -359,10 +515,7 @@ static gboolean ygtk_time_zone_picker_leave_notify_event (GtkWidget *widget,
                                                           GdkEventCrossing *event)
 {
 	YGtkTimeZonePicker *picker = YGTK_TIME_ZONE_PICKER (widget);
-	if (picker->hover_loc) {
-		picker->hover_loc = NULL;
-		gtk_widget_queue_draw (widget);
-	}
+	ygtk_time_zone_picker_set_hover (picker, NULL);
 	return FALSE;
 }
 
@@ -474,72 +627,70 @@ static gboolean ygtk_time_zone_picker_draw (GtkWidget *widget, cairo_t *cr)
 		goto cleanup;
 	}
 
-	gdk_cairo_set_source_pixbuf (cr, picker->map_pixbuf, 0, 0);
-	cairo_matrix_t matrix;
-	cairo_matrix_init_translate (&matrix, picker->map_x - (width/2)/picker->scale,
-	                             picker->map_y - (height/2)/picker->scale);
-	cairo_matrix_scale (&matrix, 1/picker->scale, 1/picker->scale);
-	cairo_pattern_set_matrix (cairo_get_source (cr), &matrix);
-
-	cairo_rectangle (cr, 0, 0, width, height);
-	cairo_fill (cr);
-
-	GList *i;
-	for (i = picker->locations; i; i = i->next) {
-		YGtkTimeZoneLocation *loc = i->data;
-		int x, y;
-		map_to_window (picker, loc->x, loc->y, &x, &y);
-		int radius = (picker->scale == 1) ? 3 : 0;
-
-		if (loc == picker->selected_loc) {
-			cairo_set_source_rgb (cr, 232/255.0, 66/255.0, 66/255.0);
-			radius = 3;
-		}
-		else if (loc == picker->hover_loc)
-			cairo_set_source_rgb (cr, 255/255.0, 255/255.0, 96/255.0);
-		else
-			cairo_set_source_rgb (cr, 192/255.0, 112/255.0, 160/255.0);
-
-		if (radius) {
-			cairo_arc (cr, x-1, y-1, radius, 0, M_PI*2);
-			if (radius > 1) {
-				cairo_fill_preserve (cr);
-				cairo_set_source_rgb (cr, 90/255.0, 90/255.0, 90/255.0);
-				cairo_set_line_width (cr, 1.0);
-				cairo_stroke (cr);
+	if (!picker->map_cache || picker->cache_scale != picker->scale ||
+	    picker->cache_map_x != picker->map_x || picker->cache_map_y != picker->map_y ||
+	    picker->cache_width != width || picker->cache_height != height) {
+		// resample the map only when the zoom or viewport changed
+		invalidate_map_cache (picker);
+		picker->map_cache = gdk_window_create_similar_surface (
+			gtk_widget_get_window (widget), CAIRO_CONTENT_COLOR, width, height);
+		picker->cache_scale = picker->scale;
+		picker->cache_map_x = picker->map_x;
+		picker->cache_map_y = picker->map_y;
+		picker->cache_width = width;
+		picker->cache_height = height;
+
+		cairo_t *cache_cr = cairo_create (picker->map_cache);
+		gdk_cairo_set_source_pixbuf (cache_cr, picker->map_pixbuf, 0, 0);
+		cairo_matrix_t matrix;
+		cairo_matrix_init_translate (&matrix, picker->map_x - (width/2)/picker->scale,
+		                             picker->map_y - (height/2)/picker->scale);
+		cairo_matrix_scale (&matrix, 1/picker->scale, 1/picker->scale);
+		cairo_pattern_set_matrix (cairo_get_source (cache_cr), &matrix);
+
+		cairo_rectangle (cache_cr, 0, 0, width, height);
+		cairo_fill (cache_cr);
+
+		// locations are only shown at close-up
+		if (picker->scale == 1 && picker->locations) {
+			guint i;
+			for (i = 0; i < picker->locations->len; i++) {
+				YGtkTimeZoneLocation *loc = &g_array_index (picker->locations,
+					YGtkTimeZoneLocation, i);
+				int x, y;
+				map_to_window (picker, loc->x, loc->y, &x, &y);
+				draw_location (cache_cr, x, y, 3, 192/255.0, 112/255.0, 160/255.0);
 			}
-			else
-				cairo_fill (cr);
 		}
+		cairo_destroy (cache_cr);
+	}
+
+	cairo_set_source_surface (cr, picker->map_cache, 0, 0);
+	cairo_paint (cr);
+
+	int x, y;
+	if (picker->hover_loc && picker->scale == 1) {
+		map_to_window (picker, picker->hover_loc->x, picker->hover_loc->y, &x, &y);
+		draw_location (cr, x, y, 3, 255/255.0, 255/255.0, 96/255.0);
+	}
+	if (picker->selected_loc) {
+		map_to_window (picker, picker->selected_loc->x, picker->selected_loc->y, &x, &y);
+		draw_location (cr, x, y, 3, 232/255.0, 66/255.0, 66/255.0);
 	}
 
 	YGtkTimeZoneLocation *label_loc = picker->hover_loc;
 	if (!label_loc)
 		label_loc = picker->selected_loc;
 	if (label_loc) {
-		const char *text = label_loc->tooltip;
-		if (!text) {
-			text = label_loc->country;
-			if (!text)
-				text = label_loc->zone;
-		}
-
-		PangoLayout *layout;
-		layout = gtk_widget_create_pango_layout (widget, text);
-
-		int x, y;
-		map_to_window (picker, label_loc->x, label_loc->y, &x, &y);
-		x += 11; y += 4;
-		int fw;
-		pango_layout_get_pixel_size (layout, &fw, NULL);
-		x = MAX (MIN (x, width - fw - 5), x-11-fw);
+		int fw, fh;
+		PangoLayout *layout = create_label_layout (picker, label_loc, &x, &y, &fw, &fh);
 
 		cairo_set_source_rgb (cr, 0, 0, 0);
-		cairo_move_to (cr, x, y);
+		cairo_move_to (cr, x+1, y+1);
 		pango_cairo_show_layout (cr, layout);
 
 		cairo_set_source_rgb (cr, 1, 1, 1);
-		cairo_move_to (cr, x-1, y-1);
+		cairo_move_to (cr, x, y);
 		pango_cairo_show_layout (cr, layout);
 		g_object_unref (G_OBJECT (layout));
 		cairo_new_path (cr);
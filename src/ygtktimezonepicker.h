@@ -45,8 +45,16 @@ struct _YGtkTimeZonePicker
 	gdouble scale;  // map-to-window scale
 	guint closeup : 2;
 
-	GList *locations;
+	GArray *locations;  // of YGtkTimeZoneLocation, by latitude
+	GHashTable *zone_index;  // zone name -> position in locations
 	YGtkTimeZoneLocation *selected_loc, *hover_loc;
+	GSList **grid;  // locations bucketed by map position, for hit testing
+	gint grid_cols, grid_rows;
+
+	// the scaled map with its location dots, re-rendered on zoom or scroll
+	cairo_surface_t *map_cache;
+	gdouble cache_scale;
+	gint cache_map_x, cache_map_y, cache_width, cache_height;
 
 	gint last_mouse_x, last_mouse_y;
 };
@@ -30,6 +30,7 @@ extern void ygutils_setWidgetFont (GtkWidget *widget, PangoStyle style,
 extern void ygutils_setPaneRelPosition (GtkWidget *paned, gdouble rel);
 extern const char *ygutils_setStockIcon (GtkWidget *button, const char *label,
                                       const char *fallbackIcon);
+extern GdkPixbuf *ygutils_loadPixbuf (const char *filename);
 extern GdkPixbuf *ygutils_setOpacity (const GdkPixbuf *src, int opacity, gboolean alpha);
 extern void ygdialog_setTitle (const gchar *title, gboolean sticky);
 extern gchar *ygutils_headerize_help (const char *help_text, gboolean *cut);
@@ -982,8 +983,7 @@ void ygtk_wizard_set_header_text (YGtkWizard *wizard, const char *text)
 
 gboolean ygtk_wizard_set_header_icon (YGtkWizard *wizard, const char *icon)
 {
-	GError *error = 0;
-	GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file (icon, &error);
+	GdkPixbuf *pixbuf = ygutils_loadPixbuf (icon);
 	if (!pixbuf)
 		return FALSE;
 	ygtk_wizard_header_set_icon (YGTK_WIZARD_HEADER (wizard->m_title), pixbuf);